@@ -0,0 +1,538 @@
+/*
+ *              ** analysis.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Analysis interface,
+ *             with all relevant functions and libraries
+ *
+ *             The analysis keeps register states only at join points
+ *             (the entry & every known jump target): each join's walk
+ *             runs straight-line code from it until a Halt, a Load
+ *             Program, or the next join, whose state it merges into.
+ *             Joins whose state grows are walked again, until none do.
+ *
+ */
+
+#include <string.h>
+
+#include "analysis.h"
+#include "instructions.h"
+
+
+#define NUM_REGISTERS 8
+
+/* no join point at (or walk owning) this word */
+#define NO_SLOT UINT32_MAX
+
+/*
+ * What is known about a register, least to most: nothing has reached
+ * it yet, one of up to ANALYSIS_MAX_TARGETS values, some nonzero value,
+ * or anything at all
+ * Note: count & values are only meaningful for REG_CONST; values keep
+ *       the order they were added in, so merging in nothing new leaves
+ *       a register exactly as it was
+ */
+typedef enum Reg_kind {
+        REG_BOTTOM = 0, REG_CONST, REG_NONZERO, REG_TOP
+} Reg_kind;
+
+typedef struct Abstract_reg {
+        uint32_t kind;
+        uint32_t count;
+        uint32_t values[ANALYSIS_MAX_TARGETS];
+} Abstract_reg;
+
+typedef struct Abstract_state {
+        Abstract_reg regs[NUM_REGISTERS];
+} Abstract_state;
+
+/* a join point: its word, whether it's queued, & what's known there */
+typedef struct Join {
+        uint32_t word;
+        int queued;
+        Abstract_state state;
+} Join;
+
+typedef struct Walker {
+        Um_analysis analysis;
+        uint32_t *words;
+
+        /* per word: its join's slot, & the slot whose walk last ran it */
+        uint32_t *join_slot;
+        uint32_t *owner;
+
+        Join *joins;
+        uint32_t num_joins;
+        uint32_t joins_capacity;
+
+        /* stack of slots to walk */
+        uint32_t *queue;
+        uint32_t num_queued;
+} Walker;
+
+
+static void add_join(Walker *walker, uint32_t word, Abstract_state *state);
+
+static void enqueue(Walker *walker, uint32_t slot);
+
+static void walk(Walker *walker, uint32_t slot);
+
+static void step(Abstract_state *state, uint32_t instruction);
+
+static void jump(Walker *walker, uint32_t word, Abstract_state *state);
+
+static int merge_state(Abstract_state *into, Abstract_state *from);
+
+static Abstract_reg join_regs(Abstract_reg a, Abstract_reg b);
+
+static Abstract_reg arithmetic(uint32_t opcode, Abstract_reg b,
+                               Abstract_reg c);
+
+static int add_value(Abstract_reg *reg, uint32_t value);
+
+static Abstract_reg known(Reg_kind kind, uint32_t value);
+
+static inline int may_be_zero(Abstract_reg reg);
+
+static inline int may_be_nonzero(Abstract_reg reg);
+
+
+/*      analyze_program
+ * Purpose: find the basic blocks, known Load Program targets, & stores
+ *          that may change code, in a program entered at one word
+ * Expectations: words holds num_words um instructions (or data)
+ * Input: the program's words, how many, the word it starts at (0 for a
+ *        fresh program; anything for a resumed one)
+ * Output: new Um_analysis, for analysis_free
+ * Note: assumes nothing about the registers at entry, so the result
+ *       holds for any machine starting there with these words in
+ *       segment 0, for as long as segment 0 is unchanged
+ */
+Um_analysis analyze_program(uint32_t *words, uint32_t num_words,
+                            uint32_t entry)
+{
+        assert(words != NULL || num_words == 0);
+
+        Um_analysis analysis = calloc(1, sizeof(*analysis));
+        assert(analysis != NULL);
+        analysis->num_words = num_words;
+        analysis->entry = entry;
+
+        /* Note: at least one byte each, so a 0 word program works too */
+        size_t words_size = (size_t)num_words + 1;
+        analysis->flags = calloc(words_size, sizeof(*analysis->flags));
+        analysis->targets = calloc(words_size, sizeof(*analysis->targets));
+
+        Walker walker;
+        memset(&walker, 0, sizeof(walker));
+        walker.analysis = analysis;
+        walker.words = words;
+        walker.join_slot = malloc(words_size * sizeof(*walker.join_slot));
+        walker.owner = malloc(words_size * sizeof(*walker.owner));
+        assert(analysis->flags != NULL && analysis->targets != NULL);
+        assert(walker.join_slot != NULL && walker.owner != NULL);
+
+        for (uint32_t word = 0; word < num_words; word++) {
+                walker.join_slot[word] = NO_SLOT;
+                walker.owner[word] = NO_SLOT;
+        }
+
+        /* nothing is known about the registers on entry */
+        Abstract_state entry_state;
+        for (int reg = 0; reg < NUM_REGISTERS; reg++) {
+                entry_state.regs[reg] = known(REG_TOP, 0);
+        }
+        add_join(&walker, entry, &entry_state);
+
+        while (walker.num_queued > 0) {
+                uint32_t slot = walker.queue[--walker.num_queued];
+                walker.joins[slot].queued = 0;
+                walk(&walker, slot);
+        }
+
+        /*
+         * a block starts at each join; with an unknown jump, any store
+         * could run with any registers
+         */
+        analysis->num_blocks = walker.num_joins;
+        for (uint32_t slot = 0; slot < walker.num_joins; slot++) {
+                analysis->flags[walker.joins[slot].word] |= ANALYSIS_LEADER;
+        }
+        for (uint32_t word = 0; word < num_words; word++) {
+                if (analysis->unknown_jumps &&
+                    UM_OPCODE(words[word]) == SSTORE) {
+                        analysis->flags[word] |= ANALYSIS_STORES_CODE;
+                }
+                if (analysis->flags[word] & ANALYSIS_STORES_CODE) {
+                        analysis->code_stores++;
+                }
+        }
+        analysis->no_self_mod = analysis->code_stores == 0;
+
+        free(walker.join_slot);
+        free(walker.owner);
+        free(walker.joins);
+        free(walker.queue);
+        return analysis;
+}
+
+/*      analysis_free
+ * Purpose: free everything analyze_program allocated
+ * Expectations: analysis came from analyze_program
+ * Input: the analysis
+ * Output: N/A, void - end result: analysis freed
+ */
+void analysis_free(Um_analysis analysis)
+{
+        assert(analysis != NULL);
+
+        free(analysis->flags);
+        free(analysis->targets);
+        free(analysis);
+}
+
+
+/*      add_join
+ * Purpose: merge a state into the join point at a word, making the word
+ *          a join point first if it isn't one yet
+ * Expectations: walker is set up
+ * Input: walker, the word, the state reaching it
+ * Output: N/A, void - end result: join's state includes the given one,
+ *         & the join is queued if that changed anything
+ * Note: a word that becomes a join after some walk ran straight through
+ *       it is queued along with that walk's join, so the state falling
+ *       into it from above is merged in too
+ */
+static void add_join(Walker *walker, uint32_t word, Abstract_state *state)
+{
+        if (word >= walker->analysis->num_words) {
+                return;
+        }
+
+        uint32_t slot = walker->join_slot[word];
+        if (slot == NO_SLOT) {
+                if (walker->num_joins == walker->joins_capacity) {
+                        walker->joins_capacity = walker->joins_capacity ?
+                                                 2 * walker->joins_capacity
+                                                 : 64;
+                        walker->joins = realloc(walker->joins,
+                                                sizeof(*walker->joins) *
+                                                walker->joins_capacity);
+                        walker->queue = realloc(walker->queue,
+                                                sizeof(*walker->queue) *
+                                                walker->joins_capacity);
+                        assert(walker->joins != NULL);
+                        assert(walker->queue != NULL);
+                }
+
+                slot = walker->num_joins++;
+                memset(&walker->joins[slot], 0, sizeof(walker->joins[slot]));
+                walker->joins[slot].word = word;
+                walker->join_slot[word] = slot;
+
+                if (walker->owner[word] != NO_SLOT) {
+                        enqueue(walker, walker->owner[word]);
+                }
+        }
+
+        if (merge_state(&walker->joins[slot].state, state)) {
+                enqueue(walker, slot);
+        }
+}
+
+/* queue a join to be walked, unless it already is */
+static void enqueue(Walker *walker, uint32_t slot)
+{
+        if (!walker->joins[slot].queued) {
+                walker->joins[slot].queued = 1;
+                walker->queue[walker->num_queued++] = slot;
+        }
+}
+
+/*      walk
+ * Purpose: run a join's state through the straight-line code after it
+ * Expectations: slot is a join
+ * Input: walker, the join's slot
+ * Output: N/A, void - end result: words flagged, & the state at the
+ *         end of the block merged into wherever it goes next
+ */
+static void walk(Walker *walker, uint32_t slot)
+{
+        Um_analysis analysis = walker->analysis;
+        Abstract_state state = walker->joins[slot].state;
+        uint32_t start = walker->joins[slot].word;
+
+        for (uint32_t word = start; word < analysis->num_words; word++) {
+                /* falling into the next join ends the block */
+                if (word != start && walker->join_slot[word] != NO_SLOT) {
+                        add_join(walker, word, &state);
+                        return;
+                }
+                walker->owner[word] = slot;
+                analysis->flags[word] |= ANALYSIS_REACHED;
+
+                uint32_t instruction = walker->words[word];
+                uint32_t opcode = UM_OPCODE(instruction);
+
+                if (opcode == HALT || opcode > LV) {
+                        return;
+                } else if (opcode == LOADP) {
+                        jump(walker, word, &state);
+                        return;
+                } else if (opcode == SSTORE &&
+                           may_be_zero(state.regs[UM_RA(instruction)])) {
+                        analysis->flags[word] |= ANALYSIS_STORES_CODE;
+                }
+                step(&state, instruction);
+        }
+}
+
+/*      step
+ * Purpose: apply one (non control flow) instruction to a state
+ * Expectations: state has no REG_BOTTOM registers
+ * Input: the state, the instruction
+ * Output: N/A, void - end result: state is what follows the instruction
+ */
+static void step(Abstract_state *state, uint32_t instruction)
+{
+        Abstract_reg *regs = state->regs;
+        Abstract_reg *ra = &regs[UM_RA(instruction)];
+        Abstract_reg b = regs[UM_RB(instruction)];
+        Abstract_reg c = regs[UM_RC(instruction)];
+        uint32_t opcode = UM_OPCODE(instruction);
+
+        switch (opcode) {
+        case CMOV:
+                if (!may_be_nonzero(c)) {
+                        break;
+                } else if (!may_be_zero(c)) {
+                        *ra = b;
+                } else {
+                        *ra = join_regs(*ra, b);
+                }
+                break;
+        case SLOAD:
+                *ra = known(REG_TOP, 0);
+                break;
+        case ADD:
+        case MUL:
+        case DIV:
+        case NAND:
+                *ra = arithmetic(opcode, b, c);
+                break;
+        case ACTIVATE:
+                /* Note: segment 0 is always mapped, so never ID 0 */
+                regs[UM_RB(instruction)] = known(REG_NONZERO, 0);
+                break;
+        case IN:
+                regs[UM_RC(instruction)] = known(REG_TOP, 0);
+                break;
+        case LV:
+                regs[UM_LV_RA(instruction)] =
+                        known(REG_CONST, UM_LV_VAL(instruction));
+                break;
+        default:
+                /* SSTORE, INACTIVATE, OUT change no registers */
+                break;
+        }
+}
+
+/*      jump
+ * Purpose: follow a Load Program: to its target if it may stay in
+ *          segment 0, & flag it if it may load another segment
+ * Expectations: word is a LOADP, state is the state just before it
+ * Input: walker, the word, the state
+ * Output: N/A, void - end result: LOADP flagged, known target merged
+ *         into (or, if unknown, recorded as such)
+ */
+static void jump(Walker *walker, uint32_t word, Abstract_state *state)
+{
+        Um_analysis analysis = walker->analysis;
+        uint32_t instruction = walker->words[word];
+        Abstract_reg segment = state->regs[UM_RB(instruction)];
+        Abstract_reg target = state->regs[UM_RC(instruction)];
+
+        if (may_be_nonzero(segment)) {
+                analysis->flags[word] |= ANALYSIS_LOADS_CODE;
+        }
+        if (!may_be_zero(segment)) {
+                return;
+        }
+
+        if (target.kind == REG_CONST &&
+            !(analysis->flags[word] & ANALYSIS_UNKNOWN)) {
+                analysis->targets[word].count = target.count;
+                for (uint32_t i = 0; i < target.count; i++) {
+                        uint32_t value = target.values[i];
+                        analysis->targets[word].words[i] = value;
+                        if (value < analysis->num_words &&
+                            !(analysis->flags[value] & ANALYSIS_TARGET)) {
+                                analysis->flags[value] |= ANALYSIS_TARGET;
+                                analysis->num_targets++;
+                        }
+                        add_join(walker, value, state);
+                }
+        } else {
+                analysis->flags[word] |= ANALYSIS_UNKNOWN;
+                analysis->targets[word].count = 0;
+                analysis->unknown_jumps = 1;
+        }
+}
+
+/* merge from into into, returning whether into changed */
+static int merge_state(Abstract_state *into, Abstract_state *from)
+{
+        int changed = 0;
+        for (int reg = 0; reg < NUM_REGISTERS; reg++) {
+                Abstract_reg merged = join_regs(into->regs[reg],
+                                                from->regs[reg]);
+                if (memcmp(&merged, &into->regs[reg], sizeof(merged)) != 0) {
+                        into->regs[reg] = merged;
+                        changed = 1;
+                }
+        }
+        return changed;
+}
+
+/* least register state covering both */
+static Abstract_reg join_regs(Abstract_reg a, Abstract_reg b)
+{
+        if (a.kind == REG_BOTTOM) {
+                return b;
+        } else if (b.kind == REG_BOTTOM) {
+                return a;
+        } else if (a.kind == REG_CONST && b.kind == REG_CONST) {
+                Abstract_reg joined = a;
+                int fits = 1;
+                for (uint32_t i = 0; i < b.count && fits; i++) {
+                        fits = add_value(&joined, b.values[i]);
+                }
+                if (fits) {
+                        return joined;
+                }
+        }
+
+        if (!may_be_zero(a) && !may_be_zero(b)) {
+                return known(REG_NONZERO, 0);
+        }
+        return known(REG_TOP, 0);
+}
+
+/*      arithmetic
+ * Purpose: what ADD, MUL, DIV or NAND gives, from what's known of its
+ *          operands
+ * Expectations: opcode is one of those four
+ * Input: opcode, what's known of rb & rc
+ * Output: every possible result, if both are known constants & the
+ *         results fit; else nonzero if they all are (or for NAND, if
+ *         either operand is known & never ~0); else unknown
+ * Note: a DIV that may divide by 0 faults, so its result is unknown
+ */
+static Abstract_reg arithmetic(uint32_t opcode, Abstract_reg b,
+                               Abstract_reg c)
+{
+        if (b.kind == REG_CONST && c.kind == REG_CONST) {
+                /* Note: an empty set, to add each result to */
+                Abstract_reg result = known(REG_CONST, 0);
+                result.count = 0;
+                int fits = 1, nonzero = 1;
+
+                for (uint32_t i = 0; i < b.count; i++) {
+                        for (uint32_t j = 0; j < c.count; j++) {
+                                uint32_t x = b.values[i], y = c.values[j];
+                                uint32_t value;
+                                if (opcode == ADD) {
+                                        value = x + y;
+                                } else if (opcode == MUL) {
+                                        value = x * y;
+                                } else if (opcode == NAND) {
+                                        value = ~(x & y);
+                                } else if (y != 0) {
+                                        value = x / y;
+                                } else {
+                                        return known(REG_TOP, 0);
+                                }
+                                fits = fits && add_value(&result, value);
+                                nonzero = nonzero && value != 0;
+                        }
+                }
+                if (fits) {
+                        return result;
+                }
+                return known(nonzero ? REG_NONZERO : REG_TOP, 0);
+        }
+
+        /* Note: ~(x & c) is nonzero for any c other than ~0 */
+        if (opcode == NAND) {
+                for (int side = 0; side < 2; side++) {
+                        Abstract_reg operand = side == 0 ? b : c;
+                        if (operand.kind != REG_CONST) {
+                                continue;
+                        }
+                        int all_ones = 0;
+                        for (uint32_t i = 0; i < operand.count; i++) {
+                                all_ones |= operand.values[i] == ~0u;
+                        }
+                        if (!all_ones) {
+                                return known(REG_NONZERO, 0);
+                        }
+                }
+        }
+        return known(REG_TOP, 0);
+}
+
+/* add a value to a REG_CONST register, returning 0 if it won't fit */
+static int add_value(Abstract_reg *reg, uint32_t value)
+{
+        for (uint32_t i = 0; i < reg->count; i++) {
+                if (reg->values[i] == value) {
+                        return 1;
+                }
+        }
+        if (reg->count == ANALYSIS_MAX_TARGETS) {
+                return 0;
+        }
+        reg->values[reg->count++] = value;
+        return 1;
+}
+
+/* a register state: one value if REG_CONST, else value is ignored */
+static Abstract_reg known(Reg_kind kind, uint32_t value)
+{
+        Abstract_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.kind = kind;
+        if (kind == REG_CONST) {
+                reg.count = 1;
+                reg.values[0] = value;
+        }
+        return reg;
+}
+
+static inline int may_be_zero(Abstract_reg reg)
+{
+        if (reg.kind != REG_CONST) {
+                return reg.kind == REG_TOP;
+        }
+        for (uint32_t i = 0; i < reg.count; i++) {
+                if (reg.values[i] == 0) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+static inline int may_be_nonzero(Abstract_reg reg)
+{
+        if (reg.kind != REG_CONST) {
+                return reg.kind != REG_BOTTOM;
+        }
+        for (uint32_t i = 0; i < reg.count; i++) {
+                if (reg.values[i] != 0) {
+                        return 1;
+                }
+        }
+        return 0;
+}
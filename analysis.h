@@ -0,0 +1,78 @@
+/*
+ *              ** analysis.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Analysis interface: static analysis of a program in
+ *             segment 0, recovering its basic blocks & Load Program
+ *             targets, & finding the stores that may change its code
+ *
+ *             Registers are tracked as one of a few known constants
+ *             (so a conditional move between two LVs stays known), known
+ *             nonzero (e.g. a Map Segment result), or unknown, from the
+ *             entry point (where all are unknown) to a fixed point. A
+ *             Load Program whose segment register may be 0 jumps to its
+ *             targets if they are known constants; if not, any word
+ *             could run next, with any registers. A store may change
+ *             code unless its segment register is known to be nonzero.
+ *
+ */
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "assert.h"
+
+
+/* what the analysis found about each word (flags, ORed together) */
+#define ANALYSIS_REACHED     0x01       /* on some path from the entry */
+#define ANALYSIS_LEADER      0x02       /* starts a basic block */
+#define ANALYSIS_TARGET      0x04       /* the entry or a known jump target */
+#define ANALYSIS_STORES_CODE 0x08       /* store that may hit segment 0 */
+#define ANALYSIS_LOADS_CODE  0x10       /* LOADP that may load new code */
+#define ANALYSIS_UNKNOWN     0x20       /* LOADP to an unknown target */
+
+/* most constants a register (& so a jump's target) is known to be */
+#define ANALYSIS_MAX_TARGETS 4
+
+/* where a Load Program may jump to in segment 0, if known */
+typedef struct Analysis_targets {
+        uint32_t count;
+        uint32_t words[ANALYSIS_MAX_TARGETS];
+} Analysis_targets;
+
+typedef struct Um_analysis {
+        uint32_t num_words;
+        uint32_t entry;
+
+        uint8_t *flags;         /* per word */
+        Analysis_targets *targets;      /* per word, for each LOADP */
+
+        uint32_t num_blocks;    /* basic blocks on some path */
+        uint32_t num_targets;   /* distinct known jump targets */
+        uint32_t code_stores;   /* words flagged ANALYSIS_STORES_CODE */
+
+        /*
+         * some jump's target is unknown, so every word may run, with
+         * any registers: reachability means little, & every store is
+         * flagged
+         */
+        int unknown_jumps;
+
+        /* proven: no store, on any path from the entry, hits segment 0 */
+        int no_self_mod;
+} *Um_analysis;
+
+
+Um_analysis analyze_program(uint32_t *words, uint32_t num_words,
+                            uint32_t entry);
+
+void analysis_free(Um_analysis analysis);
+
+
+#endif /* ANALYSIS_H */
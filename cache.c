@@ -0,0 +1,305 @@
+/*
+ *              ** cache.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Cache interface,
+ *             with all relevant functions and libraries
+ *
+ *             Entry layout (<cache_dir>/<key>.umc), in host byte order:
+ *                 Cache_header
+ *                 segment 0's reference count word (SEG_PINNED), then
+ *                 its words
+ *                 (padding to 8 bytes)
+ *                 predecode_program's records for segment 0, from word 0
+ *
+ *             The key is a hash of the .um file's bytes, & the header's
+ *             check is a hash of everything after it. An entry is only
+ *             used if its magic, the Interpreter's predecode_version,
+ *             the key, the file's size, the layout, & the check all
+ *             match; anything else is treated as missing & rewritten.
+ *             Entries are written to a temporary file & renamed into
+ *             place, so a reader never sees half of one.
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "loader.h"
+#include "interpreter.h"
+
+
+/* first 8 bytes of every entry (the last is the NUL) */
+#define CACHE_MAGIC "UMCACHE"
+
+/* seeds, so the key & the check hash the same bytes differently */
+#define KEY_SEED   0x756d2d70726f6772ULL
+#define CHECK_SEED 0x756d2d6361636865ULL
+
+typedef struct Cache_header {
+        char magic[8];
+        uint64_t key;           /* hash of the .um file */
+        uint64_t file_size;     /* of the .um file, in bytes */
+        uint64_t check;         /* hash of the rest of the entry */
+        uint64_t records_size;  /* bytes of predecoded records */
+        uint32_t version;       /* predecode_version that made them */
+        uint32_t num_words;
+} Cache_header;
+
+
+static Segments map_entry(char *entry_path, uint64_t key,
+                          uint64_t file_size, void **predecoded);
+
+static int write_entry(char *cache_dir, char *entry_path, uint64_t key,
+                       const uint8_t *program, uint64_t file_size);
+
+static size_t records_offset(uint32_t num_words);
+
+static uint64_t hash_bytes(const void *bytes, size_t size, uint64_t seed);
+
+
+/*      cache_load
+ * Purpose: set up a machine to run a .um file from its cache entry,
+ *          building the entry first if it is missing or doesn't check
+ *          out
+ * Expectations: provided file is valid (.um)
+ * Input: cache directory (made if missing), string holding filename,
+ *        pointer to fill with the predecoded records for segment 0
+ * Output: instance of Segments struct with segment 0 mapped from the
+ *         entry (pinned, so a store copies it out first), with
+ *         *predecoded pointing into the entry for Interpreter_options;
+ *         or NULL if the cache can't be used (e.g. the directory can't
+ *         be written), in which case read_file should be used instead
+ * Note: the entry stays mapped until segments_free
+ */
+Segments cache_load(char *cache_dir, char *pathname, void **predecoded)
+{
+        assert(cache_dir != NULL && pathname != NULL);
+        assert(predecoded != NULL);
+
+        int fd = open(pathname, O_RDONLY);
+        assert(fd >= 0);
+
+        struct stat program_info;
+        int stat_result = fstat(fd, &program_info);
+        assert(stat_result == 0);
+        (void)stat_result;
+        uint64_t file_size = program_info.st_size;
+
+        /* Note: mmap refuses a length of 0, so an empty file stays NULL */
+        uint8_t *program = NULL;
+        if (file_size > 0) {
+                program = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE,
+                               fd, 0);
+                assert(program != MAP_FAILED);
+        }
+        close(fd);
+
+        uint64_t key = hash_bytes(program, file_size, KEY_SEED);
+        char entry_path[strlen(cache_dir) + 32];
+        sprintf(entry_path, "%s/%016llx.umc", cache_dir,
+                (unsigned long long)key);
+
+        /*
+         * Note: the entry is built from the very bytes that were hashed,
+         *       so a program changing underneath can't mismatch its key
+         */
+        Segments all_segments = map_entry(entry_path, key, file_size,
+                                          predecoded);
+        if (all_segments == NULL &&
+            write_entry(cache_dir, entry_path, key, program, file_size)) {
+                all_segments = map_entry(entry_path, key, file_size,
+                                         predecoded);
+        }
+
+        if (program != NULL) {
+                munmap(program, file_size);
+        }
+        return all_segments;
+}
+
+
+/*      map_entry
+ * Purpose: map a cache entry & check it, then make segment 0 from it
+ * Expectations: N/A (the entry may be missing or anything at all)
+ * Input: the entry's file, the key & size of the program it should be
+ *        for, pointer to fill with the predecoded records
+ * Output: instance of Segments struct owning the mapping, or NULL if
+ *         there is no usable entry
+ */
+static Segments map_entry(char *entry_path, uint64_t key,
+                          uint64_t file_size, void **predecoded)
+{
+        int fd = open(entry_path, O_RDONLY);
+        if (fd < 0) {
+                return NULL;
+        }
+
+        struct stat entry_info;
+        int stat_result = fstat(fd, &entry_info);
+        assert(stat_result == 0);
+        (void)stat_result;
+        size_t entry_size = entry_info.st_size;
+        if (entry_size < sizeof(Cache_header)) {
+                close(fd);
+                return NULL;
+        }
+
+        /* Note: read-only, since nothing writes pinned words in place */
+        uint8_t *entry = mmap(NULL, entry_size, PROT_READ, MAP_PRIVATE,
+                              fd, 0);
+        assert(entry != MAP_FAILED);
+        close(fd);
+
+        Cache_header header;
+        memcpy(&header, entry, sizeof(header));
+        size_t records_start = records_offset(header.num_words);
+
+        int usable = memcmp(header.magic, CACHE_MAGIC,
+                            sizeof(header.magic)) == 0 &&
+                     header.version == predecode_version() &&
+                     header.key == key &&
+                     header.file_size == file_size &&
+                     header.num_words == file_size / 4 &&
+                     entry_size == records_start + header.records_size;
+        usable = usable && hash_bytes(entry + sizeof(header),
+                                      entry_size - sizeof(header),
+                                      CHECK_SEED) == header.check;
+
+        uint32_t *words = (uint32_t *)(entry + sizeof(header)) + 1;
+        if (!usable || SEG_REFS(words) != SEG_PINNED) {
+                munmap(entry, entry_size);
+                return NULL;
+        }
+
+        /* the table & stack are ordinary arrays, as segments_initialize's */
+        Segment *mapped = malloc(sizeof(*mapped));
+        uint32_t *unmapped = malloc(sizeof(*unmapped));
+        assert(mapped != NULL && unmapped != NULL);
+        mapped[0].words = words;
+        mapped[0].length = header.num_words;
+
+        Segments all_segments = segments_initialize();
+        segments_install(all_segments, mapped, 1, unmapped, 0,
+                         entry, entry_size);
+
+        *predecoded = entry + records_start;
+        return all_segments;
+}
+
+/*      write_entry
+ * Purpose: build the cache entry for a program & put it in place of
+ *          any entry already there
+ * Expectations: program holds file_size bytes (or is NULL if empty)
+ * Input: cache directory, the entry's file, the program's key, its
+ *        bytes, & how many
+ * Output: 1 if the entry was written, 0 if it couldn't be
+ */
+static int write_entry(char *cache_dir, char *entry_path, uint64_t key,
+                       const uint8_t *program, uint64_t file_size)
+{
+        if (mkdir(cache_dir, 0777) != 0 && errno != EEXIST) {
+                return 0;
+        }
+
+        size_t records_size;
+        size_t records_start = records_offset(file_size / 4);
+
+        /* segment 0, with its count, in host order */
+        uint32_t *words = calloc(records_start - sizeof(Cache_header), 1);
+        assert(words != NULL);
+        words[0] = SEG_PINNED;
+        swap_words(words + 1, program, file_size / 4);
+        void *records = predecode_program(words + 1, file_size / 4, 0,
+                                          &records_size);
+
+        /* the whole entry is built in memory, so the check can cover it */
+        size_t entry_size = records_start + records_size;
+        uint8_t *entry = calloc(entry_size, 1);
+        assert(entry != NULL);
+        memcpy(entry + sizeof(Cache_header), words,
+               records_start - sizeof(Cache_header));
+        memcpy(entry + records_start, records, records_size);
+
+        Cache_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+        header.key = key;
+        header.file_size = file_size;
+        header.check = hash_bytes(entry + sizeof(header),
+                                  entry_size - sizeof(header), CHECK_SEED);
+        header.records_size = records_size;
+        header.version = predecode_version();
+        header.num_words = file_size / 4;
+        memcpy(entry, &header, sizeof(header));
+
+        /* Note: named for this process, so concurrent runs don't collide */
+        char temp_path[strlen(entry_path) + 32];
+        sprintf(temp_path, "%s.%ld.tmp", entry_path, (long)getpid());
+
+        FILE *fp = fopen(temp_path, "wb");
+        int written = fp != NULL &&
+                      fwrite(entry, entry_size, 1, fp) == 1;
+        if (fp != NULL) {
+                written = fclose(fp) == 0 && written;
+        }
+        written = written && rename(temp_path, entry_path) == 0;
+        if (!written) {
+                unlink(temp_path);
+        }
+
+        free(entry);
+        free(records);
+        free(words);
+        return written;
+}
+
+/*      records_offset
+ * Purpose: find where the predecoded records start in an entry
+ * Expectations: N/A
+ * Input: number of words in segment 0
+ * Output: byte offset of the first record, a multiple of 8
+ */
+static size_t records_offset(uint32_t num_words)
+{
+        size_t end = sizeof(Cache_header) +
+                     sizeof(uint32_t) * ((size_t)num_words + 1);
+        return (end + 7) & ~(size_t)7;
+}
+
+/*      hash_bytes
+ * Purpose: hash a run of bytes into 64 bits, 8 bytes at a time
+ * Expectations: bytes holds size bytes (or size is 0)
+ * Input: bytes, how many, seed
+ * Output: the hash
+ * Note: not cryptographic; it only has to tell programs (& damaged
+ *       entries) apart, & be quick enough to run on every launch
+ */
+static uint64_t hash_bytes(const void *bytes, size_t size, uint64_t seed)
+{
+        const uint8_t *next = bytes;
+        uint64_t hash = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+
+        for (size_t left = size; left > 0; ) {
+                uint64_t chunk = 0;
+                size_t take = left < 8 ? left : 8;
+                memcpy(&chunk, next, take);
+                next += take;
+                left -= take;
+
+                hash ^= chunk * 0x9e3779b97f4a7c15ULL;
+                hash = ((hash << 27) | (hash >> 37)) * 0x94d049bb133111ebULL;
+        }
+
+        hash ^= hash >> 31;
+        hash *= 0xbf58476d1ce4e5b9ULL;
+        hash ^= hash >> 29;
+        return hash;
+}
@@ -0,0 +1,32 @@
+/*
+ *              ** cache.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Cache interface: a directory of preprocessed programs,
+ *             one entry per distinct .um file (named by a hash of its
+ *             contents), each holding segment 0 already in host byte
+ *             order & the Interpreter's predecoded records for it
+ *
+ *             A later run of the same program maps its entry & starts
+ *             from there: no byte swapping, decoding, fusion, or
+ *             analysis. An entry that doesn't check out (another
+ *             build's, truncated, or corrupt) is rebuilt in its place.
+ *
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "segment.h"
+
+
+Segments cache_load(char *cache_dir, char *pathname, void **predecoded);
+
+
+#endif /* CACHE_H */
@@ -0,0 +1,158 @@
+/*
+ *              ** handlergen.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Build-time generator of register-specialized handlers:
+ *             writes handlers.inc, which interpreter.c includes to get
+ *             one dispatch label per (opcode, ra, rb, rc) for each
+ *             opcode below, with its registers as constants
+ *
+ *             Usage: ./handlergen <output_file>
+ *
+ *             The file has three parts, picked by what is defined when
+ *             it is included:
+ *                 (neither) SPECIALIZED_KINDS & SPECIALIZED_KIND, saying
+ *                           which opcodes are specialized, in what order
+ *                 SPECIALIZED_TABLE   the dispatch table entries
+ *                 SPECIALIZED_CODE    the handlers themselves
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+
+/* register triples: (ra, rb, rc), 3 bits each, in index order */
+#define NUM_TRIPLES 512
+
+/*
+ * opcodes that only touch registers, each with its handler in
+ * instructions.h & the stem of its dispatch labels in interpreter.c
+ * Note: the order here is the order of their blocks in the table
+ * Note: every kind adds 512 handlers for the compiler to get through;
+ *       CMOV & DIV are left generic, as they took interpreter.c from
+ *       26s to 151s to build for a few percent on arithmetic alone
+ */
+static const struct {
+        const char *opcode;
+        const char *function;
+        const char *label;
+} kinds[] = {
+        { "ADD",  "addition",         "op_add"  },
+        { "MUL",  "multiplication",   "op_mul"  },
+        { "NAND", "bitwise_NAND",     "op_nand" },
+};
+
+#define NUM_KINDS (sizeof(kinds) / sizeof(kinds[0]))
+
+
+static void write_kinds(FILE *fp);
+static void write_table(FILE *fp);
+static void write_code(FILE *fp);
+
+
+/*      main
+ * Purpose: write every part of handlers.inc
+ * Expectations: output file can be created
+ * Input: number of command line arguments, content of arguments
+ * Output: EXIT_SUCCESS once the file is written, else EXIT_FAILURE
+ */
+int main(int argc, char *argv[])
+{
+        if (argc != 2) {
+                fprintf(stderr, "Usage: ./handlergen <output_file>\n");
+                exit(EXIT_FAILURE);
+        }
+
+        FILE *fp = fopen(argv[1], "w");
+        if (fp == NULL) {
+                perror(argv[1]);
+                exit(EXIT_FAILURE);
+        }
+
+        fprintf(fp, "/* generated by handlergen (see the Makefile): "
+                    "do not edit */\n\n");
+        write_kinds(fp);
+        write_table(fp);
+        write_code(fp);
+
+        if (fclose(fp) != 0) {
+                perror(argv[1]);
+                exit(EXIT_FAILURE);
+        }
+        return EXIT_SUCCESS;
+}
+
+
+/*      write_kinds
+ * Purpose: write the part saying which opcodes are specialized
+ * Expectations: fp is open for writing
+ * Input: stream to write to
+ * Output: N/A, void - end result: SPECIALIZED_KIND maps each opcode to
+ *         its block of handlers (or -1 if it has none)
+ */
+static void write_kinds(FILE *fp)
+{
+        fprintf(fp, "#if !defined(SPECIALIZED_TABLE) && "
+                    "!defined(SPECIALIZED_CODE)\n");
+        fprintf(fp, "#define SPECIALIZED_KINDS %u\n", (unsigned)NUM_KINDS);
+        fprintf(fp, "#define SPECIALIZED_KIND(opcode) ( \\\n");
+        for (size_t kind = 0; kind < NUM_KINDS; kind++) {
+                fprintf(fp, "        (opcode) == %s ? %u : \\\n",
+                        kinds[kind].opcode, (unsigned)kind);
+        }
+        fprintf(fp, "        -1)\n");
+        fprintf(fp, "#endif\n\n");
+}
+
+/*      write_table
+ * Purpose: write the part with a dispatch table entry per handler
+ * Expectations: fp is open for writing
+ * Input: stream to write to
+ * Output: N/A, void - end result: one designated initializer per
+ *         handler, at the index SPECIALIZED gives it
+ */
+static void write_table(FILE *fp)
+{
+        fprintf(fp, "#ifdef SPECIALIZED_TABLE\n");
+        for (size_t kind = 0; kind < NUM_KINDS; kind++) {
+                for (int triple = 0; triple < NUM_TRIPLES; triple++) {
+                        int ra = triple >> 6;
+                        int rb = (triple >> 3) & 7;
+                        int rc = triple & 7;
+                        fprintf(fp, "        [SPECIALIZED(%s, %d, %d, %d)] = "
+                                    "LABEL_ADDRESS(%s_%d_%d_%d),\n",
+                                kinds[kind].opcode, ra, rb, rc,
+                                kinds[kind].label, ra, rb, rc);
+                }
+        }
+        fprintf(fp, "#endif\n\n");
+}
+
+/*      write_code
+ * Purpose: write the part with the handlers themselves
+ * Expectations: fp is open for writing
+ * Input: stream to write to
+ * Output: N/A, void - end result: one label per handler, which runs
+ *         the opcode's inline function on constant registers &
+ *         dispatches the next word
+ */
+static void write_code(FILE *fp)
+{
+        fprintf(fp, "#ifdef SPECIALIZED_CODE\n");
+        for (size_t kind = 0; kind < NUM_KINDS; kind++) {
+                for (int triple = 0; triple < NUM_TRIPLES; triple++) {
+                        int ra = triple >> 6;
+                        int rb = (triple >> 3) & 7;
+                        int rc = triple & 7;
+                        fprintf(fp, "%s_%d_%d_%d:\n", kinds[kind].label,
+                                ra, rb, rc);
+                        fprintf(fp, "        %s(registers, %d, %d, %d);\n",
+                                kinds[kind].function, ra, rb, rc);
+                        fprintf(fp, "        DISPATCH();\n");
+                }
+        }
+        fprintf(fp, "#endif\n");
+}
@@ -18,35 +18,194 @@
 
 #include "assert.h"
 #include "segment.h"
-#include "bitpack.h"
+#include "umio.h"
 
 extern uint32_t map_seg(Segments all_segments, uint32_t num_words);
 extern void unmap_seg(Segments all_segments, uint32_t seg_ID);
 
-void conditional_move(uint32_t *registers,
-                      uint32_t ra,
-                      uint32_t rb,
-                      uint32_t rc);
 
-void segmented_load(Segments all_segments,
-                    uint32_t *registers,
-                    uint32_t ra,
-                    uint32_t rb,
-                    uint32_t rc);
+/*
+ * Guest faults: what the spec leaves undefined (a load outside any
+ * segment, division by 0, & so on)
+ * Note: um asserts the cheap ones (GUEST_ASSERT) & trusts the program
+ *       on the rest (GUEST_CHECK), which would cost the hot loop; the
+ *       library build (UM_LIBRARY: libum & um-batch) checks both, &
+ *       hands a failure to guest_fault, so a guest can't take down the
+ *       process hosting it
+ */
+#ifdef UM_LIBRARY
+#include <setjmp.h>
 
-void segmented_store(Segments all_segments, 
-                     uint32_t *registers,
-                     uint32_t ra,
-                     uint32_t rb,
-                     uint32_t rc);
+void guest_fault() __attribute__((noreturn));
+#define GUEST_CHECK(e)  ((e) ? (void)0 : guest_fault())
+#define GUEST_ASSERT(e) GUEST_CHECK(e)
 
-void addition(uint32_t *registers, uint32_t ra, uint32_t rb, uint32_t rc);
+/* 
+ * where guest_fault jumps to, on the thread running the guest: set by
+ * whoever runs it (& put back as it was once done)
+ */
+extern __thread jmp_buf *guest_fault_exit;
+#else
+#define GUEST_CHECK(e)  ((void)0)
+#define GUEST_ASSERT(e) assert(e)
+#endif
 
-void multiplication(uint32_t *registers, uint32_t ra, uint32_t rb, uint32_t rc);
 
-void division(uint32_t *registers, uint32_t ra, uint32_t rb, uint32_t rc);
+typedef enum Um_opcode {
+        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
+        NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV
+} Um_opcode;
 
-void bitwise_NAND(uint32_t *registers, uint32_t ra, uint32_t rb, uint32_t rc);
+/*
+ * Field extraction for a 32-bit um instruction
+ * Note: these stand in for Bitpack_getu in the hot loop, since the
+ *       layout never changes: opcode in the top 4 bits, ra/rb/rc in
+ *       the low 9 bits, or (for LV only) ra in bits 25-27 and a 25-bit
+ *       value below it
+ */
+#define UM_OPCODE(word) ((word) >> 28)
+#define UM_RA(word)     (((word) >> 6) & 0x7)
+#define UM_RB(word)     (((word) >> 3) & 0x7)
+#define UM_RC(word)     ((word) & 0x7)
+#define UM_LV_RA(word)  (((word) >> 25) & 0x7)
+#define UM_LV_VAL(word) ((word) & 0x1ffffff)
+
+/*
+ * Note: handlers on the hot path (those that only touch registers, &
+ *       segmented load/store) are defined here (static inline) rather
+ *       than in instructions.c, so that the dispatch loop in um.c can
+ *       inline them into each opcode's body
+ */
+
+/*      conditional_move
+ * Purpose: move value in rb over to ra
+ * Expectations: value in rc != 0, registers contain valid values
+ * Input: pointer to array of 8 registers, 3-bit values indicating
+ *        corresponding register for ra, rb, rc respectively
+ * Output: N/A, void - end result: value moved if rc != 0
+ */
+static inline void conditional_move(uint32_t *registers,
+                                    uint32_t ra,
+                                    uint32_t rb,
+                                    uint32_t rc)
+{
+        if (registers[rc] != 0) {
+                registers[ra] = registers[rb];
+        }
+}
+
+/*      segmented_load
+ * Purpose: load the word at offset rc, within segment rb, into
+ *          the register corresponding to ra
+ * Expectations: registers contain valid values, segment exists
+ * Input: struct holding the segment table & unmapped IDs,
+ *        pointer to array of 8 registers, 3-bit values indicating
+ *        corresponding register for ra, rb, rc respectively
+ * Output: N/A, void - end result: register ra updated to reflect
+ *         value of given word in given segment
+ */
+static inline void segmented_load(Segments all_segments,
+                                  uint32_t *registers,
+                                  uint32_t ra,
+                                  uint32_t rb,
+                                  uint32_t rc)
+{
+        /* identify word within specific segment */
+        GUEST_CHECK(seg_mapped(all_segments, registers[rb]) &&
+                    registers[rc] < seg_length(all_segments, registers[rb]));
+        uint32_t *segment = seg_words(all_segments, registers[rb]);
+        registers[ra] = segment[registers[rc]];
+}
+
+/*      segmented_store
+ * Purpose: take the word within register rc, & store it within 
+ *          segment ra, at the offset marked by rb
+ * Expectations: registers contain valid values, segment exists
+ * Input: struct holding the segment table & unmapped IDs,
+ *        pointer to array of 8 registers, 3-bit values indicating
+ *        corresponding register for ra, rb, rc respectively
+ * Output: N/A, void - end result: word at given offset within
+ *         given segment updated to reflect value in register 
+ *         corresponding to rc
+ */
+static inline void segmented_store(Segments all_segments,
+                                   uint32_t *registers,
+                                   uint32_t ra,
+                                   uint32_t rb,
+                                   uint32_t rc)
+{
+        /* update value of word within specific segment */
+        GUEST_CHECK(seg_mapped(all_segments, registers[ra]) &&
+                    registers[rb] < seg_length(all_segments, registers[ra]));
+        uint32_t *segment = seg_words(all_segments, registers[ra]);
+
+        /* first write to words shared by Load Program makes a copy */
+        if (SEG_REFS(segment) > 1) {
+                segment = unshare_seg(all_segments, registers[ra]);
+        }
+        segment[registers[rb]] = registers[rc];
+}
+
+/*      addition
+ * Purpose: add values in registers corresponding to rb & rc (mod 2^32), 
+ *          then store result in register ra
+ * Expectations: registers contain valid values
+ * Input: pointer to array of 8 registers, 3-bit values indicating
+ *        corresponding register for ra, rb, rc respectively
+ * Output: N/A, void - end result: sum of rb & rc stored in ra
+ */
+static inline void addition(uint32_t *registers,
+                            uint32_t ra, uint32_t rb, uint32_t rc)
+{
+        /* sum is mod 2^32 as a result of variable size */
+        registers[ra] = registers[rb] + registers[rc];
+}
+
+/*      multiplication
+ * Purpose: multiply values in registers corresponding to rb & rc 
+ *          (mod 2^32), then store result in register ra
+ * Expectations: registers contain valid values
+ * Input: pointer to array of 8 registers, 3-bit values indicating
+ *        corresponding register for ra, rb, rc respectively
+ * Output: N/A, void - end result: product of rb & rc stored in ra
+ */
+static inline void multiplication(uint32_t *registers,
+                                  uint32_t ra, uint32_t rb, uint32_t rc)
+{
+        /* product is mod 2^32 as a result of variable size */
+        registers[ra] = registers[rb] * registers[rc];
+}
+
+/*      division
+ * Purpose: divide value in registers corresponding to rb by that
+ *          of rc, then store result in register ra
+ * Expectations: rc != 0, registers contain valid values
+ * Input: pointer to array of 8 registers, 3-bit values indicating
+ *        corresponding register for ra, rb, rc respectively
+ * Output: N/A, void - end result: quotient of rb & rc stored in ra
+ */
+static inline void division(uint32_t *registers,
+                            uint32_t ra, uint32_t rb, uint32_t rc)
+{
+        /* confirm division is possible */
+        GUEST_ASSERT(registers[rc] != 0);
+        registers[ra] = registers[rb] / registers[rc];
+}
+
+/*      bitwise_NAND
+ * Purpose: get the bitwise and (&) of rb & rc, then invert it, &
+ *          store resulting value in ra
+ * Expectations: registers contain valid values
+ * Input: pointer to array of 8 registers, 3-bit values indicating
+ *        corresponding register for ra, rb, rc respectively
+ * Output: N/A, void - end result: inverse of bitwise and of rb
+ *         & rc stored in ra
+ */
+static inline void bitwise_NAND(uint32_t *registers,
+                                uint32_t ra, uint32_t rb, uint32_t rc)
+{
+        registers[ra] = ~(registers[rb] & registers[rc]);
+}
 
 /* no halt function */
 
@@ -57,9 +216,9 @@ void map_segment(Segments all_segments,
 
 void unmap_segment(Segments all_segments, uint32_t *registers, uint32_t rc);
 
-void output(uint32_t *registers, uint32_t rc);
+void output(Um_io io, uint32_t *registers, uint32_t rc);
 
-void input(uint32_t *registers, uint32_t rc);
+void input(Um_io io, uint32_t *registers, uint32_t rc);
 
 void load_program(Segments all_segments, 
                   uint32_t *registers, 
@@ -67,7 +226,21 @@ void load_program(Segments all_segments,
                   uint32_t rc,
                   uint32_t *program_counter);
 
-void load_value(uint32_t *registers, uint32_t ra, uint32_t val);
+/*      load_value
+ * Purpose: take the value at the end of the instruction and put it in
+ *          the given register
+ * Expectations: ra corresponds to one of the 8 registers
+ * Input: pointer to array of 8 registers, 3-bit value indicating
+ *        corresponding register for ra, 25-bit value to be stored
+ *        in the register
+ * Output: N/A, void - end result: given register is updated to hold
+ *         the given value
+ */
+static inline void load_value(uint32_t *registers,
+                              uint32_t ra, uint32_t val)
+{
+        registers[ra] = val;
+}
 
 
 #endif /* INSTRUCTIONS_H */
\ No newline at end of file
@@ -0,0 +1,919 @@
+/*
+ *              ** interpreter.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Interpreter interface,
+ *             with all relevant functions and libraries
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "interpreter.h"
+#include "instructions.h"
+#include "snapshot.h"
+#include "analysis.h"
+#include "profile.h"
+#include "sampler.h"
+
+/* which opcodes have register-specialized handlers (see handlergen.c) */
+#include "handlers.inc"
+
+
+#define NUM_REGISTERS 8
+
+/*
+ * Direct-threaded dispatch (GNU C labels-as-values)
+ * Note: __extension__ keeps -pedantic quiet about the label addresses
+ *       and computed gotos, which are the whole point of the loop;
+ *       PROFILE_DISPATCH is empty unless built with UM_PROFILE, while
+ *       SAMPLE_PC is one store, for --sample-profile to read
+ */
+#define LABEL_ADDRESS(label) (__extension__ &&label)
+#define DISPATCH() \
+        do { \
+                SAMPLE_PC(program_counter); \
+                SLICE_CHECK(); \
+                instruction = &decoded[program_counter++]; \
+                PROFILE_DISPATCH(instruction->opcode); \
+                __extension__ ({ goto *instruction->handler; }); \
+        } while (0)
+
+/* 
+ * step to the next word of a fused sequence without dispatching on it
+ * Note: its own entry is left intact, so a jump straight to it still
+ *       runs it (& whatever follows) on its own
+ */
+#define FUSED_NEXT() \
+        do { \
+                SAMPLE_PC(program_counter); \
+                SLICE_COUNT(); \
+                instruction = &decoded[program_counter++]; \
+                PROFILE_DISPATCH(instruction->opcode); \
+        } while (0)
+
+/* 
+ * Slices (library builds only): count every word run against the
+ * budget, & stop before the next once it's spent; also check that the
+ * program counter is in segment 0 (see GUEST_CHECK)
+ * Note: a fused sequence only starts if the budget covers all of it;
+ *       otherwise its first word runs alone, so a slice never runs
+ *       more than its budget
+ */
+#ifdef UM_LIBRARY
+#define SLICE_CHECK() \
+        do { \
+                GUEST_CHECK(program_counter < seg0_length); \
+                if (__builtin_expect(budget < MAX_FUSED, 0)) { \
+                        goto slice_end; \
+                } \
+                budget--; \
+        } while (0)
+#define SLICE_COUNT() (budget--)
+#else
+#define SLICE_CHECK() ((void)0)
+#define SLICE_COUNT() ((void)0)
+#endif
+
+/* 
+ * write out segment telemetry if SIGUSR1 has asked for it (only in
+ * counted runs, so telemetry is on if anything set the flag)
+ */
+#define TELEMETRY_POLL() \
+        do { \
+                if (__builtin_expect(segments_telemetry_wanted, 0)) { \
+                        all_segments->now = jump_base + program_counter; \
+                        segments_telemetry_write(all_segments); \
+                } \
+        } while (0)
+
+/* 
+ * in counted runs, jumps also flush output that has waited out the
+ * flush interval, even if no more is coming (see umio_flush_due)
+ */
+#define FLUSH_POLL() \
+        do { \
+                if (io->out_len > 0) { \
+                        umio_flush_due(io); \
+                } \
+        } while (0)
+
+/* 
+ * Superinstructions: common idioms run by one handler, which is only
+ * ever installed on the first word of the idiom. Their slots in the
+ * dispatch table follow the 16 opcodes.
+ * Note: SSTORE_DATA is not fused; it is the store handler for code the
+ *       Analysis module proves never stores into segment 0, which can
+ *       skip the check for one; nor is OFF_END, the handler of the
+ *       entry just past the last word, which a program that runs off
+ *       the end of segment 0 reaches
+ */
+typedef enum Um_fused {
+        LV_LV_ADD = 16, LV_SLOAD, NAND_NAND, LV_LOADP, SSTORE_DATA, OFF_END,
+        SPECIALIZED_BASE,
+        NUM_HANDLERS = SPECIALIZED_BASE + SPECIALIZED_KINDS * 512
+} Um_fused;
+
+/* 
+ * Register-specialized handlers: after the fused sequences, a block of
+ * 512 per specialized opcode, one for each (ra, rb, rc), whose
+ * registers are constants rather than loads from the predecoded word
+ */
+#define SPECIALIZED(opcode, ra, rb, rc) \
+        (SPECIALIZED_BASE + SPECIALIZED_KIND(opcode) * 512 + \
+         (ra) * 64 + (rb) * 8 + (rc))
+
+/* words in the longest fused sequence */
+#define MAX_FUSED 3
+
+/* 
+ * changes whenever the decoding does, for predecode_version
+ * Note: the handler count & record size are folded in automatically
+ */
+#define PREDECODE_VERSION 2
+
+/* 
+ * Predecoded form of one word in segment 0
+ * Note: handler is the dispatch label for the word's opcode (or for
+ *       the fused sequence it starts, or specialized to its registers),
+ *       & val is only meaningful for LV;
+ *       opcode is read by fusion & the profiler (it fits in what would
+ *       otherwise be padding)
+ */
+typedef struct Um_decoded {
+        void *handler;
+        uint8_t opcode;
+        uint8_t ra, rb, rc;
+        uint32_t val;
+} Um_decoded;
+
+
+static Um_decoded *predecode_segment(Um_decoded *decoded,
+                                     uint32_t *segment,
+                                     uint32_t num_words,
+                                     uint32_t entry,
+                                     void *const *dispatch_table);
+
+static Um_decoded *expand_predecoded(Um_decoded *records,
+                                     uint32_t num_words,
+                                     void *const *dispatch_table);
+
+static inline void predecode_word(Um_decoded *entry,
+                                  uint32_t word,
+                                  void *const *dispatch_table);
+
+static inline void predecode_end(Um_decoded *decoded,
+                                 uint32_t num_words,
+                                 void *const *dispatch_table);
+
+static inline int own_handler(Um_decoded *entry);
+
+static inline void fuse_word(Um_decoded *decoded,
+                             uint32_t word,
+                             uint32_t num_words,
+                             void *const *dispatch_table);
+
+static void print_fusion_stats(Um_decoded *decoded,
+                               uint32_t num_words,
+                               void *const *dispatch_table,
+                               FILE *fp);
+
+#ifdef UM_LIBRARY
+static int run_guarded(Segments all_segments, Um_io io,
+                       uint32_t *registers, uint32_t program_counter,
+                       Interpreter_options *options);
+#endif
+
+
+/*      interpret
+ * Purpose: run the program in segment 0 until it halts, one predecoded
+ *          word at a time
+ * Expectations: instance of Segments struct exists & segment 0 holds
+ *               the program
+ * Input: struct holding the segment table & unmapped IDs, guest I/O,
+ *        pointer to array of 8 registers to start from, program
+ *        counter to start at, options (or NULL)
+ * Output: EXIT_SUCCESS on HALT, EXIT_FAILURE on an invalid instruction,
+ *         or (slices only) INTERPRET_BUDGET or INTERPRET_INPUT
+ */
+int interpret(Segments all_segments, Um_io io,
+              uint32_t *machine_registers, uint32_t program_counter,
+              Interpreter_options *options)
+{
+        assert(all_segments != NULL);
+        assert(io != NULL);
+        assert(machine_registers != NULL);
+
+        /* 
+         * Note: a local copy, which the compiler knows nothing else can
+         *       point to, so it can keep registers out of memory
+         */
+        uint32_t registers[NUM_REGISTERS];
+        memcpy(registers, machine_registers, sizeof(registers));
+
+        char *snapshot = options != NULL ? options->snapshot : NULL;
+        int fusion_stats = options != NULL && options->fusion_stats;
+        Iolog io_log = options != NULL ? options->io_log : NULL;
+        int status;
+
+        /* 
+         * Note: only library builds run in slices; elsewhere these are
+         *       constants, so the code for slices folds away
+         */
+#ifdef UM_LIBRARY
+        Interpreter_slice *slice = options != NULL ? options->slice : NULL;
+        int64_t budget = slice == NULL || slice->budget > INT64_MAX ?
+                         INT64_MAX : (int64_t)slice->budget;
+#else
+        assert(options == NULL || options->slice == NULL);
+        Interpreter_slice *const slice = NULL;
+        const int64_t budget = INT64_MAX;
+#endif
+
+        uint32_t *segment_zero = seg_words(all_segments, 0);
+        uint32_t seg0_length = seg_length(all_segments, 0);
+
+        /* 
+         * one label per opcode, indexed by the top 4 bits of the word,
+         * then one per fused sequence, then the specialized handlers
+         * Note: opcodes 14 & 15 are not valid um instructions
+         */
+        static void *const dispatch_table[NUM_HANDLERS] = {
+                [CMOV]       = LABEL_ADDRESS(op_cmov),
+                [SLOAD]      = LABEL_ADDRESS(op_sload),
+                [SSTORE]     = LABEL_ADDRESS(op_sstore),
+                [ADD]        = LABEL_ADDRESS(op_add),
+                [MUL]        = LABEL_ADDRESS(op_mul),
+                [DIV]        = LABEL_ADDRESS(op_div),
+                [NAND]       = LABEL_ADDRESS(op_nand),
+                [HALT]       = LABEL_ADDRESS(op_halt),
+                [ACTIVATE]   = LABEL_ADDRESS(op_activate),
+                [INACTIVATE] = LABEL_ADDRESS(op_inactivate),
+                [OUT]        = LABEL_ADDRESS(op_out),
+                [IN]         = LABEL_ADDRESS(op_in),
+                [LOADP]      = LABEL_ADDRESS(op_loadp),
+                [LV]         = LABEL_ADDRESS(op_lv),
+                [14]         = LABEL_ADDRESS(op_invalid),
+                [15]         = LABEL_ADDRESS(op_invalid),
+                [LV_LV_ADD]  = LABEL_ADDRESS(op_lv_lv_add),
+                [LV_SLOAD]   = LABEL_ADDRESS(op_lv_sload),
+                [NAND_NAND]  = LABEL_ADDRESS(op_nand_nand),
+                [LV_LOADP]   = LABEL_ADDRESS(op_lv_loadp),
+                [SSTORE_DATA] = LABEL_ADDRESS(op_sstore_data),
+                [OFF_END]    = LABEL_ADDRESS(op_off_end),
+#define SPECIALIZED_TABLE
+#include "handlers.inc"
+#undef SPECIALIZED_TABLE
+        };
+
+        /* 
+         * with an I/O log, segment telemetry or a flush interval, words
+         * run are counted (see op_loadp_counted) by handlers of their
+         * own, so runs without any of them don't pay for it
+         */
+        int telemetry = all_segments->telemetry != NULL;
+        int counted = io_log != NULL || telemetry ||
+                      io->flush_interval_ns != 0;
+        void *counted_table[NUM_HANDLERS];
+        void *const *handlers = dispatch_table;
+        if (counted) {
+                memcpy(counted_table, dispatch_table, sizeof(counted_table));
+                counted_table[LOADP] = LABEL_ADDRESS(op_loadp_counted);
+                counted_table[LV_LOADP] = LABEL_ADDRESS(op_lv_loadp_counted);
+                handlers = counted_table;
+        }
+        if (telemetry) {
+                counted_table[ACTIVATE] = LABEL_ADDRESS(op_activate_counted);
+                counted_table[INACTIVATE] =
+                        LABEL_ADDRESS(op_inactivate_counted);
+        }
+
+        /* 
+         * words run since this call started: jump_base plus the program
+         * counter, since words between jumps run in order
+         * Note: only kept up to date in counted runs
+         */
+        uint64_t jump_base = -(uint64_t)program_counter;
+
+        /* 
+         * decode all of segment 0 up front, so the loop never has to
+         * (unless the cache already has)
+         */
+        Um_decoded *decoded;
+        if (slice != NULL && slice->decoded != NULL) {
+                decoded = slice->decoded;
+        } else if (options != NULL && options->predecoded != NULL) {
+                decoded = expand_predecoded(options->predecoded,
+                                            seg0_length, handlers);
+        } else {
+                decoded = predecode_segment(NULL, segment_zero, seg0_length,
+                                            program_counter, handlers);
+        }
+        if (slice != NULL) {
+                slice->decoded = decoded;
+        }
+
+        /* 
+         * fetch & execute: each handler ends by fetching the next
+         * predecoded word & jumping straight to that word's handler
+         */
+        Um_decoded *instruction;
+        DISPATCH();
+
+op_cmov:
+        conditional_move(registers, instruction->ra,
+                         instruction->rb, instruction->rc);
+        DISPATCH();
+op_sload:
+        segmented_load(all_segments, registers,
+                       instruction->ra, instruction->rb, instruction->rc);
+        DISPATCH();
+op_sstore:
+        segmented_store(all_segments, registers,
+                        instruction->ra, instruction->rb, instruction->rc);
+
+        /* 
+         * a store into segment 0 changes code, so redecode that word, &
+         * refuse every sequence that could include it
+         * Note: the store may also have unshared segment 0 (copy on write)
+         */
+        if (registers[instruction->ra] == 0) {
+                uint32_t offset = registers[instruction->rb];
+                segment_zero = seg_words(all_segments, 0);
+                predecode_word(&decoded[offset], segment_zero[offset],
+                               handlers);
+
+                uint32_t first = offset >= MAX_FUSED - 1 ?
+                                 offset - (MAX_FUSED - 1) : 0;
+                for (uint32_t word = first; word <= offset; word++) {
+                        fuse_word(decoded, word, seg0_length, handlers);
+                }
+        }
+        DISPATCH();
+op_sstore_data:
+        /* proven never to hit segment 0, so no code to redecode */
+        segmented_store(all_segments, registers,
+                        instruction->ra, instruction->rb, instruction->rc);
+        DISPATCH();
+op_add:
+        addition(registers, instruction->ra,
+                 instruction->rb, instruction->rc);
+        DISPATCH();
+op_mul:
+        multiplication(registers, instruction->ra,
+                       instruction->rb, instruction->rc);
+        DISPATCH();
+op_div:
+        division(registers, instruction->ra,
+                 instruction->rb, instruction->rc);
+        DISPATCH();
+op_nand:
+        bitwise_NAND(registers, instruction->ra,
+                     instruction->rb, instruction->rc);
+        DISPATCH();
+#define SPECIALIZED_CODE
+#include "handlers.inc"
+#undef SPECIALIZED_CODE
+op_activate: /* map_segment */
+        map_segment(all_segments, registers,
+                    instruction->rb, instruction->rc);
+        DISPATCH();
+op_inactivate: /* unmap_segment */
+        unmap_segment(all_segments, registers, instruction->rc);
+        DISPATCH();
+op_out:
+        output(io, registers, instruction->rc);
+        DISPATCH();
+op_in:
+#ifdef UM_LIBRARY
+        /* no input yet: stop before the Input, to run it next slice */
+        if (slice != NULL && !umio_ready(io)) {
+                program_counter--;
+                budget++;
+                status = INTERPRET_INPUT;
+                goto stop;
+        }
+#endif
+        /* 
+         * save the machine at the first Input, before it reads anything,
+         * so a restored run picks up here with its own input
+         */
+        if (snapshot != NULL) {
+                umio_flush(io);
+                snapshot_write(snapshot, all_segments, registers,
+                               program_counter - 1);
+                snapshot = NULL;
+        }
+        if (io_log != NULL) {
+                registers[instruction->rc] =
+                        iolog_input(io_log, io, jump_base + program_counter,
+                                    program_counter - 1);
+        } else {
+                input(io, registers, instruction->rc);
+        }
+        DISPATCH();
+op_loadp: {
+        /* 
+         * loading segment 0 itself is just a jump: the contents (& so
+         * the predecoded words) are unchanged
+         */
+        int new_code = registers[instruction->rb] != 0;
+        SAMPLE_LOADP(new_code);
+        load_program(all_segments, registers,
+                     instruction->rb, instruction->rc, &program_counter);
+
+        /* LOADP of another segment brings in new code to decode */
+        if (new_code) {
+                segment_zero = seg_words(all_segments, 0);
+                seg0_length = seg_length(all_segments, 0);
+                decoded = predecode_segment(decoded, segment_zero,
+                                            seg0_length, program_counter,
+                                            handlers);
+                if (slice != NULL) {
+                        slice->decoded = decoded;
+                }
+        }
+        DISPATCH();
+}
+op_lv:
+        load_value(registers, instruction->ra, instruction->val);
+        DISPATCH();
+
+        /* 
+         * fused sequences: each runs its words in order, exactly as the
+         * handlers above would, but dispatches only once
+         */
+op_lv_lv_add:
+        load_value(registers, instruction->ra, instruction->val);
+        FUSED_NEXT();
+        load_value(registers, instruction->ra, instruction->val);
+        FUSED_NEXT();
+        addition(registers, instruction->ra,
+                 instruction->rb, instruction->rc);
+        DISPATCH();
+op_lv_sload:
+        load_value(registers, instruction->ra, instruction->val);
+        FUSED_NEXT();
+        segmented_load(all_segments, registers,
+                       instruction->ra, instruction->rb, instruction->rc);
+        DISPATCH();
+op_nand_nand:
+        bitwise_NAND(registers, instruction->ra,
+                     instruction->rb, instruction->rc);
+        FUSED_NEXT();
+        bitwise_NAND(registers, instruction->ra,
+                     instruction->rb, instruction->rc);
+        DISPATCH();
+op_lv_loadp:
+        load_value(registers, instruction->ra, instruction->val);
+        FUSED_NEXT();
+lv_loadp_jump:
+        if (registers[instruction->rb] != 0) {
+                goto op_loadp;
+        }
+
+        /* a jump within segment 0: nothing to share or redecode */
+        PROFILE_COUNT(loadp_jumps, 1);
+        SAMPLE_LOADP(0);
+        program_counter = registers[instruction->rc];
+        DISPATCH();
+
+        /* 
+         * counted runs: jumps move jump_base back by the distance jumped
+         * (& write out telemetry SIGUSR1 asked for, & output that is due,
+         * since every loop jumps), & Map & Unmap Segment set the
+         * telemetry's clock, then each runs as above
+         */
+op_loadp_counted:
+        TELEMETRY_POLL();
+        FLUSH_POLL();
+        jump_base += (uint64_t)program_counter - registers[instruction->rc];
+        goto op_loadp;
+op_lv_loadp_counted:
+        load_value(registers, instruction->ra, instruction->val);
+        FUSED_NEXT();
+        TELEMETRY_POLL();
+        FLUSH_POLL();
+        jump_base += (uint64_t)program_counter - registers[instruction->rc];
+        goto lv_loadp_jump;
+op_activate_counted:
+        all_segments->now = jump_base + program_counter;
+        goto op_activate;
+op_inactivate_counted:
+        all_segments->now = jump_base + program_counter;
+        goto op_inactivate;
+
+op_invalid:
+        PROFILE_STOP();
+#ifndef UM_LIBRARY
+        /* Note: a library's host hears of it from um_run, not on stderr */
+        fprintf(stderr, "Invalid instruction 0x%08x at word %u\n",
+                segment_zero[program_counter - 1], program_counter - 1);
+#endif
+        status = EXIT_FAILURE;
+        goto stop;
+op_off_end:
+        /* 
+         * the word after the last one: the program never halted
+         * Note: not op_invalid, as there is no word here to report
+         */
+        PROFILE_STOP();
+#ifndef UM_LIBRARY
+        fprintf(stderr, "Ran off the end of segment 0 (%u words)\n",
+                seg0_length);
+#endif
+        status = EXIT_FAILURE;
+        goto stop;
+op_halt:
+        PROFILE_STOP();
+        status = EXIT_SUCCESS;
+        goto stop;
+
+#ifdef UM_LIBRARY
+slice_end:
+        /* too little budget left for a fused sequence: one word alone */
+        if (budget > 0) {
+                budget--;
+                instruction = &decoded[program_counter++];
+                void *handler = handlers[instruction->opcode];
+                __extension__ ({ goto *handler; });
+        }
+        status = INTERPRET_BUDGET;
+#endif
+
+stop:
+        if (telemetry) {
+                all_segments->now = jump_base + program_counter;
+        }
+
+        /* clean memory & return (a slice keeps its words for the next) */
+        if (fusion_stats) {
+                print_fusion_stats(decoded, seg0_length, handlers, stderr);
+        }
+        if (slice != NULL) {
+                slice->budget = budget;
+                slice->program_counter = program_counter;
+        } else {
+                free(decoded);
+        }
+        memcpy(machine_registers, registers, sizeof(registers));
+        return status;
+}
+
+#ifdef UM_LIBRARY
+/*      interpret_guarded
+ * Purpose: run the program in segment 0 to the end, as interpret does,
+ *          but with a guest fault ending only this run
+ * Expectations: as interpret's, with no slice in the options
+ * Input: as interpret's
+ * Output: as interpret's, & EXIT_FAILURE on a guest fault too
+ * Note: runs as one slice with no end to its budget, so the predecoded
+ *       words outlive a fault, & are freed here either way
+ */
+int interpret_guarded(Segments all_segments, Um_io io,
+                      uint32_t *registers, uint32_t program_counter,
+                      Interpreter_options *options)
+{
+        assert(options == NULL || options->slice == NULL);
+
+        Interpreter_slice slice = { UINT64_MAX, program_counter, NULL };
+        Interpreter_options guarded = { NULL, 0, NULL, NULL, NULL };
+        if (options != NULL) {
+                guarded = *options;
+        }
+        guarded.slice = &slice;
+
+        int status = run_guarded(all_segments, io, registers,
+                                 program_counter, &guarded);
+        free(slice.decoded);
+        return status;
+}
+
+/*      run_guarded
+ * Purpose: run interpret with guest faults jumping back out to here
+ * Expectations: as interpret's
+ * Input: as interpret's
+ * Output: as interpret's, or EXIT_FAILURE on a guest fault
+ * Note: apart from interpret_guarded, so that nothing of its own that
+ *       interpret changes (the slice) is in the frame setjmp saves;
+ *       nested, in case an Output runs another machine
+ */
+static int run_guarded(Segments all_segments, Um_io io,
+                       uint32_t *registers, uint32_t program_counter,
+                       Interpreter_options *options)
+{
+        jmp_buf fault;
+        jmp_buf *outer = guest_fault_exit;
+        guest_fault_exit = &fault;
+
+        int status;
+        if (setjmp(fault) == 0) {
+                status = interpret(all_segments, io, registers,
+                                   program_counter, options);
+        } else {
+                status = EXIT_FAILURE;
+        }
+        guest_fault_exit = outer;
+        return status;
+}
+#endif
+
+
+/*      predecode_program
+ * Purpose: predecode a program for the Cache module, exactly as
+ *          interpret would decode it as segment 0
+ * Expectations: words holds num_words words
+ * Input: the program's words, how many, the word it will start at,
+ *        pointer to fill with the size of the records in bytes
+ * Output: malloc'd records, one per word, for Interpreter_options
+ */
+void *predecode_program(uint32_t *words, uint32_t num_words,
+                        uint32_t entry, size_t *size)
+{
+        assert(size != NULL);
+
+        /* Note: each handler is its own index, rather than an address */
+        void *index_table[NUM_HANDLERS];
+        for (uintptr_t handler = 0; handler < NUM_HANDLERS; handler++) {
+                index_table[handler] = (void *)handler;
+        }
+
+        *size = sizeof(Um_decoded) * (size_t)num_words;
+        return predecode_segment(NULL, words, num_words, entry,
+                                 index_table);
+}
+
+/*      predecode_version
+ * Purpose: identify the format of predecode_program's records
+ * Expectations: N/A
+ * Input: N/A, none
+ * Output: a number that differs between builds whose records differ
+ */
+uint32_t predecode_version()
+{
+        return (PREDECODE_VERSION << 24) | (NUM_HANDLERS << 8) |
+               sizeof(Um_decoded);
+}
+
+
+/*      expand_predecoded
+ * Purpose: build the predecoded side array for segment 0 from records
+ *          made by predecode_program, rather than from its words
+ * Expectations: records were made for segment 0 as it is now, & for
+ *               the program counter interpret starts at
+ * Input: the records, number of words in segment 0, dispatch table
+ *        from interpret
+ * Output: pointer to a new predecoded array, with its end entry (see
+ *         predecode_end)
+ */
+static Um_decoded *expand_predecoded(Um_decoded *records,
+                                     uint32_t num_words,
+                                     void *const *dispatch_table)
+{
+        Um_decoded *decoded = malloc(sizeof(*decoded) * (num_words + 1));
+        assert(decoded != NULL);
+        memcpy(decoded, records, sizeof(*decoded) * num_words);
+
+        for (uint32_t word = 0; word < num_words; word++) {
+                uintptr_t handler = (uintptr_t)decoded[word].handler;
+                assert(handler < NUM_HANDLERS);
+                decoded[word].handler = dispatch_table[handler];
+        }
+        predecode_end(decoded, num_words, dispatch_table);
+        return decoded;
+}
+
+/*      predecode_segment
+ * Purpose: (re)build the predecoded side array for segment 0, so that
+ *          each word's handler & operands are ready before it executes,
+ *          & fuse the idioms it contains
+ * Expectations: segment holds num_words valid words, dispatch_table
+ *               has an entry for all 16 possible opcodes & every fused
+ *               sequence
+ * Input: previous predecoded array (or NULL), pointer to segment 0,
+ *        number of words in segment 0, word it will be entered at,
+ *        dispatch table from interpret
+ * Output: pointer to the predecoded array (may have moved, since it is
+ *         resized to fit the new segment 0)
+ * Note: if the Analysis module proves that no store reachable from the
+ *       entry hits segment 0, stores get SSTORE_DATA; the proof holds
+ *       until segment 0 is next replaced, which predecodes it again
+ */
+static Um_decoded *predecode_segment(Um_decoded *decoded,
+                                     uint32_t *segment,
+                                     uint32_t num_words,
+                                     uint32_t entry,
+                                     void *const *dispatch_table)
+{
+        assert(segment != NULL || num_words == 0);
+        assert(dispatch_table != NULL);
+
+        /* 
+         * Note: one entry past the last word (see predecode_end), so
+         *       realloc never acts like free either; out of memory is
+         *       the guest's fault (see GUEST_ASSERT), & the old array is
+         *       still there to be freed
+         */
+        Um_decoded *resized = realloc(decoded,
+                                      sizeof(*decoded) * (num_words + 1));
+        GUEST_ASSERT(resized != NULL);
+        decoded = resized;
+
+        for (uint32_t word = 0; word < num_words; word++) {
+                predecode_word(&decoded[word], segment[word], dispatch_table);
+        }
+
+        /* Note: only once every word is decoded, as fusion looks ahead */
+        for (uint32_t word = 0; word < num_words; word++) {
+                fuse_word(decoded, word, num_words, dispatch_table);
+        }
+        predecode_end(decoded, num_words, dispatch_table);
+
+        Um_analysis analysis = analyze_program(segment, num_words, entry);
+        if (analysis->no_self_mod) {
+                for (uint32_t word = 0; word < num_words; word++) {
+                        if (decoded[word].handler == dispatch_table[SSTORE]) {
+                                decoded[word].handler =
+                                        dispatch_table[SSTORE_DATA];
+                        }
+                }
+        }
+        analysis_free(analysis);
+
+        return decoded;
+}
+
+/*      predecode_word
+ * Purpose: break down a um instruction into its handler & operands,
+ *          & write them into an entry of the predecoded array
+ * Expectations: entry exists, dispatch_table has all 16 opcodes
+ * Input: pointer to the entry to fill, uint32_t um instruction,
+ *        dispatch table from interpret
+ * Output: N/A, void - end result: entry reflects the given word
+ */
+static inline void predecode_word(Um_decoded *entry,
+                                  uint32_t word,
+                                  void *const *dispatch_table)
+{
+        Um_opcode opcode = UM_OPCODE(word);
+        entry->opcode = opcode;
+
+        if (opcode == LV) {
+                entry->ra  = UM_LV_RA(word);
+                entry->val = UM_LV_VAL(word);
+        } else {
+                entry->ra = UM_RA(word);
+                entry->rb = UM_RB(word);
+                entry->rc = UM_RC(word);
+        }
+        entry->handler = dispatch_table[own_handler(entry)];
+}
+
+/*      predecode_end
+ * Purpose: fill the entry just past the last word of segment 0, which
+ *          the loop dispatches on if the program runs off the end
+ * Expectations: decoded has num_words + 1 entries, dispatch_table has
+ *               NUM_HANDLERS
+ * Input: predecoded array, number of words in segment 0, dispatch
+ *        table from interpret
+ * Output: N/A, void - end result: the end entry runs op_off_end
+ * Note: opcode 14, as for a word that is no um instruction, so the
+ *       profiler has a slot to count it in
+ */
+static inline void predecode_end(Um_decoded *decoded,
+                                 uint32_t num_words,
+                                 void *const *dispatch_table)
+{
+        Um_decoded *entry = &decoded[num_words];
+        entry->opcode = 14;
+        entry->ra = entry->rb = entry->rc = 0;
+        entry->val = 0;
+        entry->handler = dispatch_table[OFF_END];
+}
+
+/*      own_handler
+ * Purpose: pick the handler a predecoded word runs on its own
+ * Expectations: entry is predecoded
+ * Input: pointer to the entry
+ * Output: dispatch table index of its register-specialized handler, if
+ *         its opcode has them, else of its opcode's handler
+ */
+static inline int own_handler(Um_decoded *entry)
+{
+        /* Note: a table, so decoding long programs doesn't branch on it */
+        static const int8_t kinds[16] = {
+                SPECIALIZED_KIND(0),  SPECIALIZED_KIND(1),
+                SPECIALIZED_KIND(2),  SPECIALIZED_KIND(3),
+                SPECIALIZED_KIND(4),  SPECIALIZED_KIND(5),
+                SPECIALIZED_KIND(6),  SPECIALIZED_KIND(7),
+                SPECIALIZED_KIND(8),  SPECIALIZED_KIND(9),
+                SPECIALIZED_KIND(10), SPECIALIZED_KIND(11),
+                SPECIALIZED_KIND(12), SPECIALIZED_KIND(13),
+                SPECIALIZED_KIND(14), SPECIALIZED_KIND(15)
+        };
+        int kind = kinds[entry->opcode];
+
+        if (kind < 0) {
+                return entry->opcode;
+        }
+        return SPECIALIZED_BASE + kind * 512 +
+               entry->ra * 64 + entry->rb * 8 + entry->rc;
+}
+
+/*      fuse_word
+ * Purpose: give a predecoded word the handler for the fused sequence
+ *          that starts at it, or its own handler if none does
+ * Expectations: this word & the MAX_FUSED - 1 after it (if any) are
+ *               predecoded, dispatch_table has NUM_HANDLERS entries
+ * Input: predecoded array, index of the word, number of words in
+ *        segment 0, dispatch table from interpret
+ * Output: N/A, void - end result: only the word's handler may change;
+ *         the words after it keep their own, so jumping into the
+ *         middle of a fused sequence runs the rest of it one at a time
+ */
+static inline void fuse_word(Um_decoded *decoded,
+                             uint32_t word,
+                             uint32_t num_words,
+                             void *const *dispatch_table)
+{
+        Um_decoded *entry = &decoded[word];
+        uint32_t left = num_words - word;
+        int next = left > 1 ? decoded[word + 1].opcode : -1;
+        int after = left > 2 ? decoded[word + 2].opcode : -1;
+        int handler = own_handler(entry);
+
+        if (entry->opcode == LV && next == LV && after == ADD) {
+                handler = LV_LV_ADD;
+        } else if (entry->opcode == LV && next == SLOAD) {
+                handler = LV_SLOAD;
+        } else if (entry->opcode == LV && next == LOADP) {
+                handler = LV_LOADP;
+        } else if (entry->opcode == NAND && next == NAND) {
+                handler = NAND_NAND;
+        }
+
+        entry->handler = dispatch_table[handler];
+}
+
+/*      print_fusion_stats
+ * Purpose: report how much of segment 0 is covered by fused sequences,
+ *          & how many of each kind there are
+ * Expectations: decoded holds num_words predecoded & fused words
+ * Input: predecoded array, number of words in segment 0, dispatch
+ *        table from interpret, stream to print to
+ * Output: N/A, void - end result: one line of counts written
+ * Note: sequences can overlap (e.g. NAND NAND NAND), so words covered
+ *       counts each word once however many sequences it's part of
+ */
+static void print_fusion_stats(Um_decoded *decoded,
+                               uint32_t num_words,
+                               void *const *dispatch_table,
+                               FILE *fp)
+{
+        static const struct {
+                Um_fused fused;
+                const char *name;
+                uint32_t length;
+        } kinds[] = {
+                { LV_LV_ADD, "lv+lv+add", 3 },
+                { LV_SLOAD,  "lv+sload",  2 },
+                { NAND_NAND, "nand+nand", 2 },
+                { LV_LOADP,  "lv+loadp",  2 },
+        };
+        const size_t num_kinds = sizeof(kinds) / sizeof(kinds[0]);
+        uint32_t counts[sizeof(kinds) / sizeof(kinds[0])] = { 0 };
+
+        /* end of the furthest sequence seen so far, for covered words */
+        uint32_t covered = 0;
+        uint32_t covered_until = 0;
+
+        for (uint32_t word = 0; word < num_words; word++) {
+                uint32_t length = 1;
+                for (size_t kind = 0; kind < num_kinds; kind++) {
+                        if (decoded[word].handler ==
+                            dispatch_table[kinds[kind].fused]) {
+                                counts[kind]++;
+                                length = kinds[kind].length;
+                        }
+                }
+
+                if (length > 1 && word + length > covered_until) {
+                        covered += word + length -
+                                   (word > covered_until ? word
+                                                         : covered_until);
+                        covered_until = word + length;
+                }
+        }
+
+        double share = num_words == 0 ? 0.0 : 100.0 * covered / num_words;
+        fprintf(fp, "fusion: %u of %u words fused (%.1f%%):", covered,
+                num_words, share);
+        for (size_t kind = 0; kind < num_kinds; kind++) {
+                fprintf(fp, " %u %s", counts[kind], kinds[kind].name);
+        }
+        fprintf(fp, "\n");
+}
@@ -0,0 +1,99 @@
+/*
+ *              ** interpreter.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Interpreter interface: runs the program in segment 0
+ *             with a predecoded, direct-threaded dispatch loop
+ *
+ */
+
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "segment.h"
+#include "umio.h"
+#include "iolog.h"
+
+
+/* what interpret returns, besides EXIT_SUCCESS & EXIT_FAILURE */
+#define INTERPRET_BUDGET 2      /* the slice's budget ran out */
+#define INTERPRET_INPUT  3      /* Input would have had to wait */
+
+/* 
+ * A run in slices (library builds, UM_LIBRARY, only): each call runs
+ * at most budget words, or stops at an Input the Um_io can't serve yet
+ * (see umio_ready), & leaves where it stopped for the next call, which
+ * must be passed the registers & program_counter it left
+ * Note: decoded is segment 0's predecoded words, kept between calls;
+ *       NULL at first, & free() it once done with the machine
+ */
+typedef struct Interpreter_slice {
+        uint64_t budget;
+        uint32_t program_counter;
+        void *decoded;
+} Interpreter_slice;
+
+/* optional extras for a run; a NULL Interpreter_options means none */
+typedef struct Interpreter_options {
+        char *snapshot;         /* save the machine at the first Input */
+        int fusion_stats;       /* report fused share of code at the end */
+
+        /* 
+         * predecode_program's records for segment 0 as it is at the
+         * start, made for the program counter it starts at (or NULL)
+         */
+        void *predecoded;
+
+        Interpreter_slice *slice;       /* run in slices (or NULL) */
+
+        /* 
+         * record every Input's value in the log, or replay them from it
+         * Note: the log's instruction counts start from this call
+         */
+        Iolog io_log;
+} Interpreter_options;
+
+
+/*
+ * Note: starts from the given registers & program counter (all 0 for a
+ *       fresh program) & leaves the final registers in the array;
+ *       returns EXIT_SUCCESS once the program halts, or EXIT_FAILURE on
+ *       an invalid instruction. Everything it uses is per call, so
+ *       separate machines can run on separate threads.
+ */
+int interpret(Segments all_segments, Um_io io,
+              uint32_t *registers, uint32_t program_counter,
+              Interpreter_options *options);
+
+#ifdef UM_LIBRARY
+/*
+ * Note: as interpret, to the end, but a guest fault (see GUEST_CHECK)
+ *       only ends this run, with EXIT_FAILURE, instead of jumping out
+ *       of it; library builds only
+ */
+int interpret_guarded(Segments all_segments, Um_io io,
+                      uint32_t *registers, uint32_t program_counter,
+                      Interpreter_options *options);
+#endif
+
+/*
+ * Predecoded programs, for the Cache module to keep on disk: the same
+ * records interpret builds for segment 0 (one per word, fused &
+ * analyzed), but with dispatch table indices in place of label
+ * addresses, so they don't depend on where the binary is loaded.
+ * Note: the version changes with the records' layout & the handlers,
+ *       so records made by a different build are never used
+ */
+void *predecode_program(uint32_t *words, uint32_t num_words,
+                        uint32_t entry, size_t *size);
+
+uint32_t predecode_version();
+
+
+#endif /* INTERPRETER_H */
@@ -0,0 +1,223 @@
+/*
+ *              ** iolog.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Iolog interface,
+ *             with all relevant functions and libraries
+ *
+ *             Log layout, in host byte order:
+ *                 Iolog_header
+ *                 one Iolog_entry per Input run, in order
+ *
+ *             A recording goes through stdio, flushed whenever the
+ *             guest is about to wait on input, so a session killed at
+ *             a prompt still has everything it read. A replay maps the
+ *             log & reads the entries straight out of the mapping.
+ *
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "iolog.h"
+
+
+/* first 8 bytes of every log (the last is the NUL) */
+#define IOLOG_MAGIC "UMIOLOG"
+
+typedef struct Iolog_header {
+        char magic[8];
+} Iolog_header;
+
+typedef struct Iolog_entry {
+        uint64_t instructions;  /* run when it was loaded, counting it */
+        uint32_t word;          /* of segment 0 holding the Input */
+        uint32_t value;         /* loaded into $r[C] (maybe UMIO_EOF) */
+} Iolog_entry;
+
+struct Iolog {
+        FILE *fp;               /* recording only (else NULL) */
+
+        /* replaying only: the mapped log, & its entries */
+        uint8_t *image;
+        size_t image_size;
+        Iolog_entry *entries;
+        uint64_t num_entries;
+
+        uint64_t next;          /* entries recorded or replayed so far */
+};
+
+
+static void diverge(Iolog log, Um_io io, uint64_t instructions,
+                    uint32_t word);
+
+
+/*      iolog_record
+ * Purpose: start a log of the guest's input
+ * Expectations: N/A
+ * Input: string holding the log's filename (created, or truncated)
+ * Output: new Iolog, which iolog_input appends to
+ */
+Iolog iolog_record(char *pathname)
+{
+        assert(pathname != NULL);
+
+        Iolog log = calloc(1, sizeof(*log));
+        assert(log != NULL);
+        log->fp = fopen(pathname, "wb");
+        assert(log->fp != NULL);
+
+        Iolog_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, IOLOG_MAGIC, sizeof(header.magic));
+        size_t written = fwrite(&header, sizeof(header), 1, log->fp);
+        assert(written == 1);
+        (void)written;
+        return log;
+}
+
+/*      iolog_replay
+ * Purpose: open a log made by iolog_record, to feed it back
+ * Expectations: provided file is a log
+ * Input: string holding the log's filename
+ * Output: new Iolog, which iolog_input reads from
+ * Note: a torn entry at the end (from a recording killed mid-write) is
+ *       left off
+ */
+Iolog iolog_replay(char *pathname)
+{
+        assert(pathname != NULL);
+
+        int fd = open(pathname, O_RDONLY);
+        assert(fd >= 0);
+
+        struct stat log_info;
+        int stat_result = fstat(fd, &log_info);
+        assert(stat_result == 0);
+        (void)stat_result;
+        size_t image_size = log_info.st_size;
+        assert(image_size >= sizeof(Iolog_header));
+
+        uint8_t *image = mmap(NULL, image_size, PROT_READ, MAP_PRIVATE,
+                              fd, 0);
+        assert(image != MAP_FAILED);
+        close(fd);
+        assert(memcmp(image, IOLOG_MAGIC, sizeof(IOLOG_MAGIC)) == 0);
+
+        Iolog log = calloc(1, sizeof(*log));
+        assert(log != NULL);
+        log->image = image;
+        log->image_size = image_size;
+        log->entries = (Iolog_entry *)(image + sizeof(Iolog_header));
+        log->num_entries = (image_size - sizeof(Iolog_header)) /
+                           sizeof(Iolog_entry);
+        return log;
+}
+
+/*      iolog_input
+ * Purpose: run one Input instruction against the log: record the value
+ *          read from io, or replay the recorded one
+ * Expectations: log came from iolog_record or iolog_replay
+ * Input: the log, guest I/O, instructions run so far (counting this
+ *        Input), word of segment 0 holding it
+ * Output: value to load into $r[C]: the next byte of input, or
+ *         UMIO_EOF once input is exhausted
+ * Note: a replay that reaches an Input somewhere other than where the
+ *       recording did (or past its end) flushes the guest's output &
+ *       exits with EXIT_FAILURE
+ */
+uint32_t iolog_input(Iolog log, Um_io io, uint64_t instructions,
+                     uint32_t word)
+{
+        assert(log != NULL && io != NULL);
+
+        if (log->fp == NULL) {
+                if (log->next == log->num_entries) {
+                        diverge(log, io, instructions, word);
+                }
+
+                Iolog_entry *entry = &log->entries[log->next];
+                if (entry->instructions != instructions ||
+                    entry->word != word) {
+                        diverge(log, io, instructions, word);
+                }
+                log->next++;
+                return entry->value;
+        }
+
+        /* nothing buffered: the read may wait on a person, so save all */
+        if (io->in_pos == io->in_len) {
+                fflush(log->fp);
+        }
+
+        Iolog_entry entry = { instructions, word, umio_get(io) };
+        size_t written = fwrite(&entry, sizeof(entry), 1, log->fp);
+        assert(written == 1);
+        (void)written;
+        log->next++;
+        return entry.value;
+}
+
+/*      iolog_close
+ * Purpose: finish with a log, noting any of a replay left unused
+ * Expectations: log came from iolog_record or iolog_replay, summary is
+ *               open
+ * Input: the log, stream for a warning
+ * Output: N/A, void - end result: a recording written out, & log freed
+ */
+void iolog_close(Iolog log, FILE *summary)
+{
+        assert(log != NULL && summary != NULL);
+
+        if (log->fp != NULL) {
+                int closed = fclose(log->fp);
+                assert(closed == 0);
+                (void)closed;
+        } else {
+                if (log->next < log->num_entries) {
+                        fprintf(summary, "replay: the program stopped with "
+                                         "%llu of %llu inputs left\n",
+                                (unsigned long long)(log->num_entries -
+                                                     log->next),
+                                (unsigned long long)log->num_entries);
+                }
+                munmap(log->image, log->image_size);
+        }
+        free(log);
+}
+
+
+/*      diverge
+ * Purpose: stop a replay that has gone another way than its recording
+ * Expectations: log is a replay
+ * Input: the log, guest I/O, instructions run & word of the Input
+ * Output: N/A, never returns - end result: output so far written, the
+ *         difference reported, & the process exits with EXIT_FAILURE
+ */
+static void diverge(Iolog log, Um_io io, uint64_t instructions,
+                    uint32_t word)
+{
+        umio_flush(io);
+
+        if (log->next == log->num_entries) {
+                fprintf(stderr, "replay: Input %llu, at instruction %llu "
+                                "(word %u), is past the end of the log\n",
+                        (unsigned long long)log->next + 1,
+                        (unsigned long long)instructions, word);
+        } else {
+                Iolog_entry *entry = &log->entries[log->next];
+                fprintf(stderr, "replay: Input %llu came at instruction "
+                                "%llu (word %u), not %llu (word %u) as "
+                                "recorded\n",
+                        (unsigned long long)log->next + 1,
+                        (unsigned long long)instructions, word,
+                        (unsigned long long)entry->instructions,
+                        entry->word);
+        }
+        exit(EXIT_FAILURE);
+}
@@ -0,0 +1,44 @@
+/*
+ *              ** iolog.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Iolog interface: records every value the guest's Input
+ *             instructions load (./um --record <log>), with the number
+ *             of instructions run when each was loaded, & feeds them
+ *             back in a later run (./um --replay <log>) in place of
+ *             stdin, so an interactive session can be rerun exactly, as
+ *             a benchmark
+ *
+ *             A replay checks each Input comes at the instruction (&
+ *             word) it did when recorded, & stops the machine with a
+ *             message if not, so a run that went another way is never
+ *             timed as if it were the same one.
+ *
+ */
+
+#ifndef IOLOG_H
+#define IOLOG_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "umio.h"
+
+
+typedef struct Iolog *Iolog;
+
+
+Iolog iolog_record(char *pathname);
+
+Iolog iolog_replay(char *pathname);
+
+uint32_t iolog_input(Iolog log, Um_io io, uint64_t instructions,
+                     uint32_t word);
+
+void iolog_close(Iolog log, FILE *summary);
+
+
+#endif /* IOLOG_H */
@@ -0,0 +1,827 @@
+/*
+ *              ** jit.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Jit interface, with all relevant
+ *             functions and libraries
+ *
+ *             Segment 0 is translated one basic block at a time into an
+ *             mmap'd buffer, which is never writable & executable at
+ *             once: only the part a block is being written to is made
+ *             writable, & executable again before it runs. Inside
+ *             translated code the 8 um
+ *             registers live in host registers r8d-r15d & rbx points at
+ *             the Jit_state below. Anything that touches segments or I/O
+ *             calls back into the Instructions module through a small C
+ *             helper. Blocks end at LOADP, HALT, or an invalid opcode; a
+ *             LOADP of segment 0 jumps straight to the target's block if
+ *             it has already been translated. A store into translated
+ *             words drops only the blocks holding them, & a word that
+ *             stores keep rewriting is no longer translated at all:
+ *             blocks stop short of it, & it runs on its own, in C.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "instructions.h"
+
+
+#define NUM_REGISTERS 8
+
+/* bytes of executable memory, & the most um words in a single block */
+#define JIT_BUFFER_SIZE (32 * 1024 * 1024)
+#define JIT_MAX_BLOCK 256
+
+/* no um instruction translates to more than this many bytes */
+#define JIT_MAX_INSTRUCTION_BYTES 128
+
+/* host register numbers, as used in ModRM/REX encodings */
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7 };
+
+/* um register r lives in host register r8d + r */
+#define HOST(r) (8 + (int)(r))
+
+/* why translated code handed control back to jit_execute */
+typedef enum Jit_exit {
+        JIT_HALT = 0, JIT_JUMP, JIT_STALE, JIT_LOADP, JIT_FAULT
+} Jit_exit;
+
+/* 
+ * a store hits only blocks that start at most this many words before it
+ * Note: every block is at most JIT_MAX_BLOCK words long
+ */
+#define JIT_REACH (JIT_MAX_BLOCK - 1)
+
+/* a word whose blocks stores have dropped this often runs untranslated */
+#define JIT_MAX_REWRITES 8
+
+/* with a flush interval, jumps leave to jit_execute this often to poll it */
+#define JIT_FLUSH_POLL 4096
+
+typedef struct Jit_state {
+        /* um registers, only up to date while outside translated code */
+        uint32_t registers[NUM_REGISTERS];
+
+        /* where to resume after an exit */
+        uint32_t program_counter;
+
+        /* rb << 3 | rc for a JIT_LOADP exit */
+        uint32_t loadp_operands;
+
+        /* jumps left until the next flush poll (see emit_jump_eax) */
+        uint32_t flush_countdown;
+
+        /* 
+         * native entry point for each word of segment 0 (or NULL), &
+         * the word after the last of the block starting there
+         */
+        void **blocks;
+        uint32_t *ends;
+
+        /* 
+         * words in segment 0, how many blocks each is part of, & how
+         * often a store into it has dropped blocks (up to
+         * JIT_MAX_REWRITES)
+         */
+        uint32_t num_words;
+        uint16_t *covered;
+        uint8_t *rewrites;
+
+        Segments all_segments;
+        Um_io io;
+
+        /* executable buffer, with the entry & exit stubs at its start */
+        uint8_t *buffer;
+        size_t used;
+        size_t stubs_end;
+        uint8_t *exit_stub;
+        size_t page_size;
+} Jit_state;
+
+typedef Jit_exit (*Jit_entry)(Jit_state *state, void *block);
+
+
+static Jit_exit run_word(Jit_state *state);
+static void *translate(Jit_state *state, uint32_t start);
+static void *translate_block(Jit_state *state, uint32_t start);
+static void emit_stubs(Jit_state *state);
+static void protect(Jit_state *state, size_t from, size_t to, int prot);
+static int invalidate_word(Jit_state *state, uint32_t word);
+static void flush_translations(Jit_state *state);
+static void resize_segment_zero(Jit_state *state);
+
+
+/*      jit_execute
+ * Purpose: run the program in segment 0 to completion, translating
+ *          blocks as they're first reached & dispatching between them
+ * Expectations: instance of Segments struct exists & segment 0 holds
+ *               the program
+ * Input: struct holding the segment table & unmapped IDs, guest I/O,
+ *        pointer to array of 8 registers to start from, program
+ *        counter to start at
+ * Output: EXIT_SUCCESS on HALT, EXIT_FAILURE on any fault
+ */
+int jit_execute(Segments all_segments, Um_io io,
+                uint32_t *registers, uint32_t program_counter)
+{
+        assert(all_segments != NULL);
+        assert(io != NULL);
+        assert(registers != NULL);
+
+        Jit_state state;
+        memset(&state, 0, sizeof(state));
+        memcpy(state.registers, registers, sizeof(state.registers));
+        state.program_counter = program_counter;
+        state.all_segments = all_segments;
+        state.io = io;
+
+        /* written while writable, then executable from then on */
+        state.page_size = sysconf(_SC_PAGESIZE);
+        state.buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (state.buffer == MAP_FAILED) {
+                fprintf(stderr, "um: unable to map JIT code buffer\n");
+                return EXIT_FAILURE;
+        }
+
+        emit_stubs(&state);
+        protect(&state, 0, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC);
+        resize_segment_zero(&state);
+
+        /* Note: copied rather than cast, as ISO C has no data -> code cast */
+        Jit_entry enter;
+        void *entry_stub = state.buffer;
+        memcpy(&enter, &entry_stub, sizeof(enter));
+
+        int status = EXIT_FAILURE;
+        for (;;) {
+                uint32_t pc = state.program_counter;
+                Jit_exit reason;
+
+                if (io->flush_interval_ns != 0) {
+                        umio_flush_due(io);
+                        state.flush_countdown = JIT_FLUSH_POLL;
+                }
+
+                if (pc < state.num_words &&
+                    state.rewrites[pc] == JIT_MAX_REWRITES) {
+                        reason = run_word(&state);
+                } else {
+                        void *block = pc < state.num_words ? state.blocks[pc]
+                                                           : NULL;
+                        if (block == NULL) {
+                                block = translate(&state, pc);
+                        }
+                        if (block == NULL) {
+                                /* out of code space, so start over empty */
+                                flush_translations(&state);
+                                block = translate(&state, pc);
+                                assert(block != NULL);
+                        }
+                        reason = enter(&state, block);
+                }
+
+                if (reason == JIT_HALT) {
+                        status = EXIT_SUCCESS;
+                        break;
+                } else if (reason == JIT_STALE) {
+                        /* 
+                         * a store rewrote code we had translated, & its
+                         * blocks are gone: go on from the next word
+                         */
+                } else if (reason == JIT_LOADP) {
+                        load_program(all_segments, state.registers,
+                                     state.loadp_operands >> 3,
+                                     state.loadp_operands & 0x7,
+                                     &state.program_counter);
+                        resize_segment_zero(&state);
+                } else if (reason == JIT_FAULT) {
+                        fprintf(stderr, "um: fault at word %u\n",
+                                state.program_counter);
+                        break;
+                }
+        }
+
+        free(state.blocks);
+        free(state.ends);
+        free(state.covered);
+        free(state.rewrites);
+        munmap(state.buffer, JIT_BUFFER_SIZE);
+        return status;
+}
+
+
+/*
+ * Helpers called from translated code. Each takes register *values*
+ * rather than indices, & routes them through the Instructions module
+ * using a scratch register file.
+ */
+
+static uint32_t jit_load(Jit_state *state, uint32_t seg_ID, uint32_t offset)
+{
+        uint32_t scratch[3] = { 0, seg_ID, offset };
+        segmented_load(state->all_segments, scratch, 0, 1, 2);
+        return scratch[0];
+}
+
+/* returns 1 if the store overwrote translated code (now dropped) */
+static uint32_t jit_store(Jit_state *state,
+                          uint32_t seg_ID,
+                          uint32_t offset,
+                          uint32_t value)
+{
+        uint32_t scratch[3] = { seg_ID, offset, value };
+        segmented_store(state->all_segments, scratch, 0, 1, 2);
+
+        return seg_ID == 0 && offset < state->num_words &&
+               state->covered[offset] > 0 && invalidate_word(state, offset);
+}
+
+static uint32_t jit_map(Jit_state *state, uint32_t num_words)
+{
+        uint32_t scratch[2] = { 0, num_words };
+        map_segment(state->all_segments, scratch, 0, 1);
+        return scratch[0];
+}
+
+static void jit_unmap(Jit_state *state, uint32_t seg_ID)
+{
+        uint32_t scratch[1] = { seg_ID };
+        unmap_segment(state->all_segments, scratch, 0);
+}
+
+static void jit_output(Jit_state *state, uint32_t value)
+{
+        uint32_t scratch[1] = { value };
+        output(state->io, scratch, 0);
+}
+
+static uint32_t jit_input(Jit_state *state)
+{
+        uint32_t scratch[1] = { 0 };
+        input(state->io, scratch, 0);
+        return scratch[0];
+}
+
+
+/*
+ * x86-64 encoders. Only the handful of forms the translator needs:
+ * 32-bit register-to-register ops, loads/stores relative to rbx (the
+ * Jit_state pointer), immediates, & rel32 branches.
+ */
+
+static inline void emit8(Jit_state *state, uint8_t byte)
+{
+        state->buffer[state->used++] = byte;
+}
+
+static inline void emit32(Jit_state *state, uint32_t value)
+{
+        memcpy(state->buffer + state->used, &value, sizeof(value));
+        state->used += sizeof(value);
+}
+
+static inline void emit64(Jit_state *state, uint64_t value)
+{
+        memcpy(state->buffer + state->used, &value, sizeof(value));
+        state->used += sizeof(value);
+}
+
+/* opcode with a register-direct ModRM byte (reg, rm) */
+static void emit_rr(Jit_state *state, uint8_t opcode, int reg, int rm)
+{
+        uint8_t rex = 0x40 | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+        if (rex != 0x40) {
+                emit8(state, rex);
+        }
+        emit8(state, opcode);
+        emit8(state, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* same, for the two-byte 0F xx opcodes (imul, cmovcc) */
+static void emit_rr_0f(Jit_state *state, uint8_t opcode, int reg, int rm)
+{
+        uint8_t rex = 0x40 | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+        if (rex != 0x40) {
+                emit8(state, rex);
+        }
+        emit8(state, 0x0F);
+        emit8(state, opcode);
+        emit8(state, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* opcode with a [rbx + disp32] operand; wide selects 64-bit */
+static void emit_rbx(Jit_state *state, int wide, uint8_t opcode,
+                     int reg, size_t disp)
+{
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) >> 1);
+        if (rex != 0x40) {
+                emit8(state, rex);
+        }
+        emit8(state, opcode);
+        emit8(state, 0x80 | ((reg & 7) << 3) | RBX);
+        emit32(state, (uint32_t)disp);
+}
+
+static void emit_mov_imm(Jit_state *state, int reg, uint32_t value)
+{
+        if (reg & 8) {
+                emit8(state, 0x41);
+        }
+        emit8(state, 0xB8 | (reg & 7));
+        emit32(state, value);
+}
+
+static void emit_push(Jit_state *state, int reg)
+{
+        if (reg & 8) {
+                emit8(state, 0x41);
+        }
+        emit8(state, 0x50 | (reg & 7));
+}
+
+static void emit_pop(Jit_state *state, int reg)
+{
+        if (reg & 8) {
+                emit8(state, 0x41);
+        }
+        emit8(state, 0x58 | (reg & 7));
+}
+
+/* jcc rel32 with the target left blank, returns where to patch */
+static size_t emit_jcc_forward(Jit_state *state, uint8_t condition)
+{
+        emit8(state, 0x0F);
+        emit8(state, 0x80 | condition);
+        emit32(state, 0);
+        return state->used - 4;
+}
+
+static void patch_to_here(Jit_state *state, size_t patch)
+{
+        uint32_t rel = (uint32_t)(state->used - (patch + 4));
+        memcpy(state->buffer + patch, &rel, sizeof(rel));
+}
+
+#define CC_Z  0x4
+#define CC_NZ 0x5
+#define CC_AE 0x3
+
+static void emit_jmp_exit_stub(Jit_state *state)
+{
+        emit8(state, 0xE9);
+        int64_t rel = state->exit_stub - (state->buffer + state->used + 4);
+        emit32(state, (uint32_t)(int32_t)rel);
+}
+
+/* leave translated code, resuming later at a known program counter */
+static void emit_exit(Jit_state *state, Jit_exit reason, uint32_t pc)
+{
+        emit_rbx(state, 0, 0xC7, 0,
+                 offsetof(Jit_state, program_counter));
+        emit32(state, pc);
+        emit_mov_imm(state, RAX, reason);
+        emit_jmp_exit_stub(state);
+}
+
+/*
+ * continue at the program counter held in eax: straight into its block
+ * if there is one, otherwise back out to jit_execute to translate it
+ * (& with a flush interval, every JIT_FLUSH_POLL jumps, to poll it)
+ */
+static void emit_jump_eax(Jit_state *state)
+{
+        size_t poll = 0;
+        if (state->io->flush_interval_ns != 0) {
+                /* dec dword [rbx + flush_countdown] */
+                emit_rbx(state, 0, 0xFF, 1,
+                         offsetof(Jit_state, flush_countdown));
+                poll = emit_jcc_forward(state, CC_Z);
+        }
+        emit_rbx(state, 0, 0x3B, RAX, offsetof(Jit_state, num_words));
+        size_t out_of_range = emit_jcc_forward(state, CC_AE);
+
+        emit_rbx(state, 1, 0x8B, RDX, offsetof(Jit_state, blocks));
+        /* mov rdx, [rdx + rax * 8] */
+        emit8(state, 0x48); emit8(state, 0x8B);
+        emit8(state, 0x14); emit8(state, 0xC2);
+        /* test rdx, rdx */
+        emit8(state, 0x48); emit8(state, 0x85); emit8(state, 0xD2);
+        size_t untranslated = emit_jcc_forward(state, CC_Z);
+        /* jmp rdx */
+        emit8(state, 0xFF); emit8(state, 0xE2);
+
+        if (state->io->flush_interval_ns != 0) {
+                patch_to_here(state, poll);
+        }
+        patch_to_here(state, out_of_range);
+        patch_to_here(state, untranslated);
+        emit_rbx(state, 0, 0x89, RAX, offsetof(Jit_state, program_counter));
+        emit_mov_imm(state, RAX, JIT_JUMP);
+        emit_jmp_exit_stub(state);
+}
+
+/*
+ * call a helper with rdi = state & up to three um registers as the
+ * remaining arguments, keeping the caller-saved r8d-r11d intact
+ * Note: four pushes keep rsp 16-byte aligned for the call
+ */
+static void emit_call(Jit_state *state, uintptr_t helper,
+                      int num_args, int arg1, int arg2, int arg3)
+{
+        for (int reg = 8; reg <= 11; reg++) {
+                emit_push(state, reg);
+        }
+
+        /* mov rdi, rbx */
+        emit8(state, 0x48); emit8(state, 0x89); emit8(state, 0xDF);
+        if (num_args > 0) {
+                emit_rr(state, 0x89, arg1, RSI);
+        }
+        if (num_args > 1) {
+                emit_rr(state, 0x89, arg2, RDX);
+        }
+        if (num_args > 2) {
+                emit_rr(state, 0x89, arg3, RCX);
+        }
+
+        /* mov rax, helper; call rax */
+        emit8(state, 0x48); emit8(state, 0xB8);
+        emit64(state, helper);
+        emit8(state, 0xFF); emit8(state, 0xD0);
+
+        for (int reg = 11; reg >= 8; reg--) {
+                emit_pop(state, reg);
+        }
+}
+
+
+/*      emit_stubs
+ * Purpose: write the entry & exit stubs at the start of the buffer
+ * Expectations: buffer is mapped & nothing has been emitted yet
+ * Input: pointer to Jit_state
+ * Output: N/A, void - end result: the buffer starts with a function
+ *         Jit_exit enter(Jit_state *, void *block), & exit_stub marks
+ *         the code that every block jumps to when it leaves
+ */
+static void emit_stubs(Jit_state *state)
+{
+        /* entry: save callee-saved registers, load the um registers */
+        emit_push(state, RBX);
+        emit_push(state, RBP);
+        for (int reg = 12; reg <= 15; reg++) {
+                emit_push(state, reg);
+        }
+        /* sub rsp, 8 (realign); mov rbx, rdi */
+        emit8(state, 0x48); emit8(state, 0x83);
+        emit8(state, 0xEC); emit8(state, 0x08);
+        emit8(state, 0x48); emit8(state, 0x89); emit8(state, 0xFB);
+
+        for (int r = 0; r < NUM_REGISTERS; r++) {
+                emit_rbx(state, 0, 0x8B, HOST(r),
+                         offsetof(Jit_state, registers) + 4 * r);
+        }
+        /* jmp rsi */
+        emit8(state, 0xFF); emit8(state, 0xE6);
+
+        /* exit: store the um registers & return the reason in eax */
+        state->exit_stub = state->buffer + state->used;
+        for (int r = 0; r < NUM_REGISTERS; r++) {
+                emit_rbx(state, 0, 0x89, HOST(r),
+                         offsetof(Jit_state, registers) + 4 * r);
+        }
+        emit8(state, 0x48); emit8(state, 0x83);
+        emit8(state, 0xC4); emit8(state, 0x08);
+        for (int reg = 15; reg >= 12; reg--) {
+                emit_pop(state, reg);
+        }
+        emit_pop(state, RBP);
+        emit_pop(state, RBX);
+        emit8(state, 0xC3);
+
+        state->stubs_end = state->used;
+}
+
+
+/*      run_word
+ * Purpose: run the word of segment 0 at the program counter without
+ *          translating it, as for words that stores keep rewriting
+ * Expectations: program counter is within segment 0, & no translated
+ *               code is running
+ * Input: pointer to Jit_state
+ * Output: JIT_JUMP to go on from the program counter it leaves, or
+ *         JIT_LOADP, JIT_HALT or JIT_FAULT as a block would exit
+ */
+static Jit_exit run_word(Jit_state *state)
+{
+        uint32_t pc = state->program_counter;
+        uint32_t word = seg_words(state->all_segments, 0)[pc];
+        uint32_t *registers = state->registers;
+        uint32_t ra = UM_RA(word), rb = UM_RB(word), rc = UM_RC(word);
+        state->program_counter = pc + 1;
+
+        switch (UM_OPCODE(word)) {
+        case CMOV:
+                conditional_move(registers, ra, rb, rc);
+                break;
+        case SLOAD:
+                registers[ra] = jit_load(state, registers[rb], registers[rc]);
+                break;
+        case SSTORE:
+                /* Note: its blocks are dropped, & none are running */
+                jit_store(state, registers[ra], registers[rb], registers[rc]);
+                break;
+        case ADD:
+                addition(registers, ra, rb, rc);
+                break;
+        case MUL:
+                multiplication(registers, ra, rb, rc);
+                break;
+        case DIV:
+                if (registers[rc] == 0) {
+                        state->program_counter = pc;
+                        return JIT_FAULT;
+                }
+                division(registers, ra, rb, rc);
+                break;
+        case NAND:
+                bitwise_NAND(registers, ra, rb, rc);
+                break;
+        case HALT:
+                state->program_counter = pc;
+                return JIT_HALT;
+        case ACTIVATE:
+                registers[rb] = jit_map(state, registers[rc]);
+                break;
+        case INACTIVATE:
+                jit_unmap(state, registers[rc]);
+                break;
+        case OUT:
+                jit_output(state, registers[rc]);
+                break;
+        case IN:
+                registers[rc] = jit_input(state);
+                break;
+        case LOADP:
+                /* segment 0 is a plain jump, as in a block */
+                if (registers[rb] == 0) {
+                        state->program_counter = registers[rc];
+                        break;
+                }
+                state->loadp_operands = (rb << 3) | rc;
+                return JIT_LOADP;
+        case LV:
+                load_value(registers, UM_LV_RA(word), UM_LV_VAL(word));
+                break;
+        default:
+                state->program_counter = pc;
+                return JIT_FAULT;
+        }
+        return JIT_JUMP;
+}
+
+/*      translate
+ * Purpose: translate a block, with the part of the buffer it may be
+ *          written to writable only meanwhile
+ * Expectations: as translate_block's
+ * Input: pointer to Jit_state, program counter of the block's start
+ * Output: as translate_block's
+ */
+static void *translate(Jit_state *state, uint32_t start)
+{
+        size_t from = state->used;
+        size_t to = from + JIT_MAX_BLOCK * JIT_MAX_INSTRUCTION_BYTES;
+        if (to > JIT_BUFFER_SIZE) {
+                to = JIT_BUFFER_SIZE;
+        }
+
+        protect(state, from, to, PROT_READ | PROT_WRITE);
+        void *block = translate_block(state, start);
+        protect(state, from, to, PROT_READ | PROT_EXEC);
+        return block;
+}
+
+/*      protect
+ * Purpose: change the protection of part of the buffer
+ * Expectations: from <= to <= JIT_BUFFER_SIZE
+ * Input: pointer to Jit_state, byte offsets of the part, PROT_* flags
+ * Output: N/A, void - end result: every page holding a byte of the
+ *         part has the given protection
+ */
+static void protect(Jit_state *state, size_t from, size_t to, int prot)
+{
+        size_t start = from / state->page_size * state->page_size;
+        int changed = mprotect(state->buffer + start, to - start, prot);
+        assert(changed == 0);
+        (void)changed;
+}
+
+/*      translate_block
+ * Purpose: translate the basic block of segment 0 that starts at the
+ *          given word into native code
+ * Expectations: stubs have been emitted, the per-word tables are sized
+ *               for the current segment 0, & the buffer is writable
+ *               from state->used on (see translate)
+ * Input: pointer to Jit_state, program counter of the block's start
+ * Output: native entry point of the block, or NULL if the buffer is
+ *         too full to hold a block of the maximum size
+ */
+static void *translate_block(Jit_state *state, uint32_t start)
+{
+        size_t worst_case = JIT_MAX_BLOCK * JIT_MAX_INSTRUCTION_BYTES;
+        if (state->used + worst_case > JIT_BUFFER_SIZE) {
+                return NULL;
+        }
+
+        uint32_t *segment_zero = seg_words(state->all_segments, 0);
+        uint8_t *block = state->buffer + state->used;
+        uint32_t pc = start;
+
+        for (uint32_t count = 0; ; count++) {
+                if (pc >= state->num_words) {
+                        emit_exit(state, JIT_FAULT, pc);
+                        break;
+                }
+                if (count == JIT_MAX_BLOCK) {
+                        emit_mov_imm(state, RAX, pc);
+                        emit_jump_eax(state);
+                        break;
+                }
+                if (count > 0 && state->rewrites[pc] == JIT_MAX_REWRITES) {
+                        /* stores keep rewriting it: run_word runs it */
+                        emit_exit(state, JIT_JUMP, pc);
+                        break;
+                }
+
+                uint32_t word = segment_zero[pc];
+                pc++;
+
+                Um_opcode opcode = UM_OPCODE(word);
+                int ra = HOST(UM_RA(word));
+                int rb = HOST(UM_RB(word));
+                int rc = HOST(UM_RC(word));
+
+                if (opcode == CMOV) {
+                        emit_rr(state, 0x85, rc, rc);
+                        emit_rr_0f(state, 0x45, ra, rb);
+                } else if (opcode == SLOAD) {
+                        emit_call(state, (uintptr_t)jit_load, 2, rb, rc, 0);
+                        emit_rr(state, 0x89, RAX, ra);
+                } else if (opcode == SSTORE) {
+                        emit_call(state, (uintptr_t)jit_store, 3, ra, rb, rc);
+                        emit_rr(state, 0x85, RAX, RAX);
+                        size_t fresh = emit_jcc_forward(state, CC_Z);
+                        emit_exit(state, JIT_STALE, pc);
+                        patch_to_here(state, fresh);
+                } else if (opcode == ADD) {
+                        emit_rr(state, 0x89, rb, RAX);
+                        emit_rr(state, 0x01, rc, RAX);
+                        emit_rr(state, 0x89, RAX, ra);
+                } else if (opcode == MUL) {
+                        emit_rr(state, 0x89, rb, RAX);
+                        emit_rr_0f(state, 0xAF, RAX, rc);
+                        emit_rr(state, 0x89, RAX, ra);
+                } else if (opcode == DIV) {
+                        emit_rr(state, 0x85, rc, rc);
+                        size_t nonzero = emit_jcc_forward(state, CC_NZ);
+                        emit_exit(state, JIT_FAULT, pc - 1);
+                        patch_to_here(state, nonzero);
+                        emit_rr(state, 0x89, rb, RAX);
+                        emit_rr(state, 0x31, RDX, RDX);
+                        emit_rr(state, 0xF7, 6, rc);
+                        emit_rr(state, 0x89, RAX, ra);
+                } else if (opcode == NAND) {
+                        emit_rr(state, 0x89, rb, RAX);
+                        emit_rr(state, 0x21, rc, RAX);
+                        emit_rr(state, 0xF7, 2, RAX);
+                        emit_rr(state, 0x89, RAX, ra);
+                } else if (opcode == HALT) {
+                        emit_exit(state, JIT_HALT, pc - 1);
+                        break;
+                } else if (opcode == ACTIVATE) {
+                        emit_call(state, (uintptr_t)jit_map, 1, rc, 0, 0);
+                        emit_rr(state, 0x89, RAX, rb);
+                } else if (opcode == INACTIVATE) {
+                        emit_call(state, (uintptr_t)jit_unmap, 1, rc, 0, 0);
+                } else if (opcode == OUT) {
+                        emit_call(state, (uintptr_t)jit_output, 1, rc, 0, 0);
+                } else if (opcode == IN) {
+                        emit_call(state, (uintptr_t)jit_input, 0, 0, 0, 0);
+                        emit_rr(state, 0x89, RAX, rc);
+                } else if (opcode == LOADP) {
+                        /* segment 0 is a plain jump, anything else exits */
+                        emit_rr(state, 0x89, rc, RAX);
+                        emit_rr(state, 0x85, rb, rb);
+                        size_t replace = emit_jcc_forward(state, CC_NZ);
+                        emit_jump_eax(state);
+
+                        patch_to_here(state, replace);
+                        emit_rbx(state, 0, 0xC7, 0,
+                                 offsetof(Jit_state, loadp_operands));
+                        emit32(state, (UM_RB(word) << 3) | UM_RC(word));
+                        emit_exit(state, JIT_LOADP, pc);
+                        break;
+                } else if (opcode == LV) {
+                        emit_mov_imm(state, HOST(UM_LV_RA(word)),
+                                     UM_LV_VAL(word));
+                } else {
+                        emit_exit(state, JIT_FAULT, pc - 1);
+                        break;
+                }
+        }
+
+        /* Note: a block can't start past the end, but its exit can */
+        if (start < state->num_words) {
+                uint32_t end = pc < state->num_words ? pc : state->num_words;
+                for (uint32_t word = start; word < end; word++) {
+                        state->covered[word]++;
+                }
+                state->blocks[start] = block;
+                state->ends[start] = end;
+        }
+        return block;
+}
+
+/*      invalidate_word
+ * Purpose: drop every block that a word of segment 0 is part of
+ * Expectations: no translated code is running past the store that
+ *               changed the word (see JIT_STALE)
+ * Input: pointer to Jit_state, the word
+ * Output: 1 if any block was dropped, else 0
+ * Note: a dropped block's code stays in the buffer, unused, until it is
+ *       next flushed; jumps look blocks up as they go, so none lead
+ *       into it
+ */
+static int invalidate_word(Jit_state *state, uint32_t word)
+{
+        uint32_t first = word > JIT_REACH ? word - JIT_REACH : 0;
+        int dropped = 0;
+
+        for (uint32_t start = first; start <= word; start++) {
+                if (state->blocks[start] == NULL ||
+                    state->ends[start] <= word) {
+                        continue;
+                }
+                for (uint32_t w = start; w < state->ends[start]; w++) {
+                        state->covered[w]--;
+                }
+                state->blocks[start] = NULL;
+                dropped = 1;
+        }
+
+        if (dropped && state->rewrites[word] < JIT_MAX_REWRITES) {
+                state->rewrites[word]++;
+        }
+        return dropped;
+}
+
+
+/*      flush_translations
+ * Purpose: throw away every translated block
+ * Expectations: no translated code is running
+ * Input: pointer to Jit_state
+ * Output: N/A, void - end result: buffer holds only the stubs, & no
+ *         word of segment 0 is considered translated
+ */
+static void flush_translations(Jit_state *state)
+{
+        memset(state->blocks, 0, sizeof(*state->blocks) * state->num_words);
+        memset(state->covered, 0, sizeof(*state->covered) * state->num_words);
+        state->used = state->stubs_end;
+}
+
+/*      resize_segment_zero
+ * Purpose: size the per-word tables for a (new) segment 0 & drop all
+ *          translations of the old one
+ * Expectations: segment 0 is mapped
+ * Input: pointer to Jit_state
+ * Output: N/A, void - end result: blocks, ends, covered & rewrites
+ *         match segment 0 (with no word rewritten yet)
+ */
+static void resize_segment_zero(Jit_state *state)
+{
+        state->num_words = seg_length(state->all_segments, 0);
+
+        /* Note: at least one entry, so realloc never acts like free */
+        state->blocks = realloc(state->blocks, sizeof(*state->blocks) *
+                                               (state->num_words + 1));
+        state->ends = realloc(state->ends, sizeof(*state->ends) *
+                                           (state->num_words + 1));
+        state->covered = realloc(state->covered, sizeof(*state->covered) *
+                                                 (state->num_words + 1));
+        state->rewrites = realloc(state->rewrites, state->num_words + 1);
+        assert(state->blocks != NULL && state->ends != NULL &&
+               state->covered != NULL && state->rewrites != NULL);
+        memset(state->rewrites, 0, state->num_words);
+
+        flush_translations(state);
+}
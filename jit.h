@@ -0,0 +1,35 @@
+/*
+ *              ** jit.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Jit interface: translates basic blocks of segment 0
+ *             into native x86-64 code & runs them, as an alternative
+ *             to the interpreter loop in um.c
+ *
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "segment.h"
+#include "umio.h"
+
+
+/*
+ * Note: starts from the given registers & program counter (all 0 for a
+ *       fresh program); returns EXIT_SUCCESS once the program halts, or
+ *       EXIT_FAILURE if it faults (invalid opcode, division by zero,
+ *       running off the end of segment 0) or the host cannot give us
+ *       executable memory
+ */
+int jit_execute(Segments all_segments, Um_io io,
+                uint32_t *registers, uint32_t program_counter);
+
+
+#endif /* JIT_H */
@@ -0,0 +1,153 @@
+/*
+ *              ** libum.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the libum interface,
+ *             with all relevant functions and libraries
+ *
+ *             Built (with the machine's own modules) as *.lib.o, with
+ *             UM_LIBRARY defined: the interpreter then counts a budget
+ *             & can stop at any word, & every guest fault goes to
+ *             guest_fault (Instructions module), which jumps back out
+ *             to um_run.
+ *
+ */
+
+#include <string.h>
+#include <setjmp.h>
+
+#include "libum.h"
+#include "segment.h"
+#include "umio.h"
+#include "loader.h"
+#include "instructions.h"
+#include "interpreter.h"
+
+
+#define NUM_REGISTERS 8
+
+#if UM_INPUT_AGAIN != UMIO_AGAIN
+#error "UM_INPUT_AGAIN must match UMIO_AGAIN"
+#endif
+
+struct Um_vm {
+        Segments all_segments;
+        Um_io io;
+        uint32_t registers[NUM_REGISTERS];
+        Interpreter_slice slice;        /* where the last run stopped */
+        uint64_t instructions;          /* run so far, in all slices */
+
+        /* once halted or faulted, the machine stays that way */
+        int done;
+        Um_status status;
+};
+
+/*      um_create
+ * Purpose: make a machine ready to run a program, from its image
+ * Expectations: image holds a .um program (big-endian words), & the
+ *               callbacks are valid for as long as the machine is
+ * Input: the image, its size in bytes, I/O callbacks
+ * Output: new machine, with segment 0 holding the program & the
+ *         registers all 0; the image may be freed straight away
+ */
+Um_vm um_create(const uint8_t *image, size_t size, Um_callbacks callbacks)
+{
+        assert(image != NULL || size == 0);
+
+        Um_vm vm = calloc(1, sizeof(*vm));
+        assert(vm != NULL);
+
+        vm->all_segments = segments_initialize();
+        uint32_t num_words = size / 4;
+        uint32_t seg_ID = map_seg(vm->all_segments, num_words);
+        assert(seg_ID == 0);
+        (void)seg_ID;
+        swap_words(seg_words(vm->all_segments, 0), image, num_words);
+
+        vm->io = umio_new_callbacks(callbacks.input, callbacks.output,
+                                    callbacks.context);
+        return vm;
+}
+
+/*      um_run
+ * Purpose: run a machine for one slice
+ * Expectations: vm was made by um_create & isn't running on any other
+ *               thread
+ * Input: the machine, most instructions to run
+ * Output: why it stopped (see Um_status); output so far has been
+ *         passed to the output callback
+ */
+Um_status um_run(Um_vm vm, uint64_t max_instructions)
+{
+        assert(vm != NULL);
+        if (vm->done) {
+                return vm->status;
+        }
+
+        /* Note: interpret counts in an int64_t */
+        uint64_t budget = max_instructions > INT64_MAX ? INT64_MAX
+                                                       : max_instructions;
+        Interpreter_options options = { NULL, 0, NULL, &vm->slice, NULL };
+        vm->slice.budget = budget;
+
+        /*
+         * Note: nested, in case an output callback runs another machine;
+         *       nothing set between here & a fault is read after it
+         */
+        jmp_buf fault;
+        jmp_buf *outer = guest_fault_exit;
+        guest_fault_exit = &fault;
+
+        int status;
+        if (setjmp(fault) == 0) {
+                status = interpret(vm->all_segments, vm->io, vm->registers,
+                                   vm->slice.program_counter, &options);
+                vm->instructions += budget - vm->slice.budget;
+        } else {
+                status = EXIT_FAILURE;
+        }
+        guest_fault_exit = outer;
+        umio_flush(vm->io);
+
+        switch (status) {
+        case INTERPRET_BUDGET:
+                return UM_BUDGET_EXHAUSTED;
+        case INTERPRET_INPUT:
+                return UM_NEEDS_INPUT;
+        default:
+                vm->done = 1;
+                vm->status = status == EXIT_SUCCESS ? UM_HALTED : UM_FAULT;
+                return vm->status;
+        }
+}
+
+/*      um_instructions
+ * Purpose: report how much a machine has run
+ * Expectations: vm was made by um_create
+ * Input: the machine
+ * Output: instructions run in all its slices so far (not counting the
+ *         slice it faulted in, if it did)
+ */
+uint64_t um_instructions(Um_vm vm)
+{
+        assert(vm != NULL);
+        return vm->instructions;
+}
+
+/*      um_destroy
+ * Purpose: free a machine & everything it has mapped
+ * Expectations: vm was made by um_create & isn't running
+ * Input: the machine
+ * Output: N/A, void - end result: vm freed; pending output has been
+ *         passed to the output callback
+ */
+void um_destroy(Um_vm vm)
+{
+        assert(vm != NULL);
+        umio_free(vm->io);
+        segments_free(vm->all_segments);
+        free(vm->slice.decoded);
+        free(vm);
+}
@@ -0,0 +1,68 @@
+/*
+ *              ** libum.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The libum interface: the machine as a library (libum.a),
+ *             for running um programs inside a long-lived process
+ *
+ *             Each Um_vm is a whole machine, made from a .um image in
+ *             memory, whose I/O goes through callbacks. um_run runs it
+ *             for at most a given number of instructions, so a few
+ *             threads can take turns running thousands of machines in
+ *             slices; it returns early if the program halts, faults,
+ *             or wants input the host doesn't have yet.
+ *
+ *             A fault (anything the spec leaves undefined, e.g. a load
+ *             outside any segment, division by 0, or an invalid
+ *             instruction) stops only that machine. Machines share no
+ *             state, so different ones may run on different threads at
+ *             once, but each must only be run by one thread at a time.
+ *
+ */
+
+#ifndef LIBUM_H
+#define LIBUM_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+
+typedef struct Um_vm *Um_vm;
+
+typedef enum Um_status {
+        UM_HALTED,              /* the program halted */
+        UM_BUDGET_EXHAUSTED,    /* ran max_instructions; run it again */
+        UM_NEEDS_INPUT,         /* Input has to wait; run it again later */
+        UM_FAULT                /* the program did something undefined */
+} Um_status;
+
+/* what an input callback returns when it has no bytes ready yet */
+#define UM_INPUT_AGAIN (-1)
+
+/*
+ * The machine's I/O
+ * Note: input puts up to size bytes of input in bytes, & returns how
+ *       many, 0 once input has ended (for good), or UM_INPUT_AGAIN;
+ *       output is given bytes the program has output, at the latest by
+ *       the end of each um_run
+ */
+typedef struct Um_callbacks {
+        long (*input)(void *context, uint8_t *bytes, size_t size);
+        void (*output)(void *context, const uint8_t *bytes, size_t size);
+        void *context;
+} Um_callbacks;
+
+
+Um_vm um_create(const uint8_t *image, size_t size, Um_callbacks callbacks);
+
+Um_status um_run(Um_vm vm, uint64_t max_instructions);
+
+uint64_t um_instructions(Um_vm vm);
+
+void um_destroy(Um_vm vm);
+
+
+#endif /* LIBUM_H */
@@ -0,0 +1,214 @@
+/*
+ *              ** loader.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Loader interface,
+ *             with all relevant functions and libraries
+ *
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "loader.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+static void swap_words_scalar(uint32_t *dest,
+                              const uint8_t *src,
+                              size_t num_words);
+
+static void read_words(int fd, size_t file_size, uint32_t *dest);
+
+
+/*      read_file
+ * Purpose: map the .um file into memory, then set up program by
+ *          instantiating segment 0 & converting the file's big-endian
+ *          words into it in bulk
+ * Expectations: provided file is valid (.um), instance of Segments
+ *               struct exists & is valid
+ * Input: string holding filename specified on command line, 
+ *        struct holding the segment table & unmapped IDs
+ * Output: uint32_t holding segment 0 (the full program)
+*/
+uint32_t *read_file(char *pathname, Segments all_segments)
+{
+        assert(pathname != NULL);
+        assert(all_segments != NULL);
+
+        int fd = open(pathname, O_RDONLY);
+        assert(fd >= 0);
+
+        /* 
+         * get info on the already-open file
+         * Note: size of file divided by 4 since 32-bit word == 4 bytes,
+         * so this gives us total number of 32-bit words
+         */
+        struct stat program_info;
+        int stat_result = fstat(fd, &program_info);
+        assert(stat_result == 0);
+        (void)stat_result;
+
+        /* Note: will only read up to the last complete word in file */
+        const size_t total_words = program_info.st_size / 4;
+
+        map_seg(all_segments, total_words);
+        uint32_t *segment_zero = seg_words(all_segments, 0);
+
+        read_words(fd, program_info.st_size, segment_zero);
+        close(fd);
+        return segment_zero;
+}
+
+/*      read_pinned_file
+ * Purpose: load a .um file into words of its own, outside any Segments,
+ *          so that many machines can map it (read-only) as segment 0
+ * Expectations: provided file is valid (.um)
+ * Input: string holding filename, pointer to fill with number of words
+ * Output: the program's words, preceded by a SEG_REFS of SEG_PINNED
+ */
+uint32_t *read_pinned_file(char *pathname, uint32_t *num_words)
+{
+        assert(pathname != NULL);
+        assert(num_words != NULL);
+
+        int fd = open(pathname, O_RDONLY);
+        assert(fd >= 0);
+
+        struct stat program_info;
+        int stat_result = fstat(fd, &program_info);
+        assert(stat_result == 0);
+        (void)stat_result;
+        *num_words = program_info.st_size / 4;
+
+        uint32_t *block = malloc(sizeof(*block) * ((size_t)*num_words + 1));
+        assert(block != NULL);
+        block[0] = SEG_PINNED;
+
+        read_words(fd, program_info.st_size, block + 1);
+        close(fd);
+        return block + 1;
+}
+
+/*      read_words
+ * Purpose: map an open .um file & convert every complete word in it
+ * Expectations: fd is open for reading, dest has room for file_size / 4
+ *               words
+ * Input: file descriptor, size of the file in bytes, destination words
+ * Output: N/A, void - end result: dest holds the program in host order
+ */
+static void read_words(int fd, size_t file_size, uint32_t *dest)
+{
+        /* Note: mmap refuses a length of 0, & there is nothing to do */
+        size_t total_words = file_size / 4;
+        if (total_words == 0) {
+                return;
+        }
+
+        uint8_t *bytes = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        assert(bytes != MAP_FAILED);
+        madvise(bytes, file_size, MADV_SEQUENTIAL);
+
+        swap_words(dest, bytes, total_words);
+        munmap(bytes, file_size);
+}
+
+
+#if defined(__x86_64__)
+
+/* reverses the bytes of each 32-bit lane */
+#define BSWAP32_SHUFFLE 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+
+/*      swap_words_avx2 / swap_words_ssse3
+ * Purpose: convert big-endian words to host order 8 (or 4) at a time
+ *          with a byte shuffle, finishing any remainder in scalar code
+ * Expectations: CPU supports the named instruction set
+ * Input: destination words, source bytes, number of words
+ * Output: N/A, void - end result: dest holds the converted words
+ */
+__attribute__((target("avx2")))
+static void swap_words_avx2(uint32_t *dest,
+                            const uint8_t *src,
+                            size_t num_words)
+{
+        const __m256i shuffle = _mm256_setr_epi8(BSWAP32_SHUFFLE,
+                                                 BSWAP32_SHUFFLE);
+        size_t word = 0;
+        for (; word + 8 <= num_words; word += 8) {
+                __m256i big = _mm256_loadu_si256((const __m256i *)
+                                                 (src + 4 * word));
+                _mm256_storeu_si256((__m256i *)(dest + word),
+                                    _mm256_shuffle_epi8(big, shuffle));
+        }
+
+        swap_words_scalar(dest + word, src + 4 * word, num_words - word);
+}
+
+__attribute__((target("ssse3")))
+static void swap_words_ssse3(uint32_t *dest,
+                             const uint8_t *src,
+                             size_t num_words)
+{
+        const __m128i shuffle = _mm_setr_epi8(BSWAP32_SHUFFLE);
+        size_t word = 0;
+        for (; word + 4 <= num_words; word += 4) {
+                __m128i big = _mm_loadu_si128((const __m128i *)
+                                              (src + 4 * word));
+                _mm_storeu_si128((__m128i *)(dest + word),
+                                 _mm_shuffle_epi8(big, shuffle));
+        }
+
+        swap_words_scalar(dest + word, src + 4 * word, num_words - word);
+}
+
+#endif
+
+/*      swap_words
+ * Purpose: convert a run of big-endian (file order) words to host order,
+ *          using the widest byte shuffle the CPU supports
+ * Expectations: dest has room for num_words, src holds 4 * num_words
+ *               bytes
+ * Input: destination words, source bytes, number of words
+ * Output: N/A, void - end result: dest holds the converted words
+ */
+void swap_words(uint32_t *dest, const uint8_t *src, size_t num_words)
+{
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2")) {
+                swap_words_avx2(dest, src, num_words);
+                return;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+                swap_words_ssse3(dest, src, num_words);
+                return;
+        }
+#endif
+        swap_words_scalar(dest, src, num_words);
+}
+
+/*      swap_words_scalar
+ * Purpose: convert big-endian words to host order one at a time
+ * Expectations: as for swap_words
+ * Input: destination words, source bytes, number of words
+ * Output: N/A, void - end result: dest holds the converted words
+ */
+static void swap_words_scalar(uint32_t *dest,
+                              const uint8_t *src,
+                              size_t num_words)
+{
+        for (size_t word = 0; word < num_words; word++) {
+                const uint8_t *bytes = src + 4 * word;
+                dest[word] = (uint32_t)bytes[0] << 24 |
+                             (uint32_t)bytes[1] << 16 |
+                             (uint32_t)bytes[2] << 8  |
+                             (uint32_t)bytes[3];
+        }
+}
@@ -0,0 +1,30 @@
+/*
+ *              ** loader.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Loader interface: reads a .um file into segment 0
+ * 
+ */
+
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "assert.h"
+#include "segment.h"
+
+
+uint32_t *read_file(char *pathname, Segments all_segments);
+
+/* Note: the words are malloc'd behind a SEG_PINNED count; free(words - 1) */
+uint32_t *read_pinned_file(char *pathname, uint32_t *num_words);
+
+void swap_words(uint32_t *dest, const uint8_t *src, size_t num_words);
+
+
+#endif /* LOADER_H */
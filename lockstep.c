@@ -0,0 +1,467 @@
+/*
+ *              ** lockstep.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Lockstep interface,
+ *             with all relevant functions and libraries
+ *
+ *             The group keeps one program counter, & each register as
+ *             an array with a slot per lane. The vector operations run
+ *             over every slot, whether its lane is still in the group or
+ *             not (one that has left keeps its own copy of its
+ *             registers), so only what touches segments or I/O needs the
+ *             list of lanes still in it.
+ *
+ *             Built for um-batch, as a library build (UM_LIBRARY), so a
+ *             lane that would fault leaves first, & faults on its own.
+ *
+ */
+
+#include <string.h>
+
+#include "lockstep.h"
+#include "instructions.h"
+#include "interpreter.h"
+
+
+#define NUM_REGISTERS 8
+
+/*
+ * 8 lanes of a register: one AVX2 register
+ * Note: may_alias, as the same slots are also read one lane at a time
+ */
+typedef uint32_t Lane_vector __attribute__((vector_size(32), may_alias));
+#define VECTOR_LANES 8
+
+/*
+ * the step loop is built twice, for AVX2 & for any x86-64, & the CPU
+ * picks one when the program starts; elsewhere the vectors are split
+ * into whatever the target has
+ */
+#if defined(__x86_64__)
+#define VECTOR_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define VECTOR_CLONES
+#endif
+
+typedef struct Lockstep_group {
+        uint32_t registers[NUM_REGISTERS][LOCKSTEP_MAX_LANES]
+                __attribute__((aligned(32)));
+        int num_vectors;        /* covering every lane */
+
+        uint32_t *program;
+        uint32_t num_words;
+
+        Lockstep_lane *lanes;
+        int num_lanes;
+
+        /* 
+         * indices of the lanes still in the group, & a slot per lane of
+         * all 1s for those (0 for the rest)
+         */
+        uint8_t active[LOCKSTEP_MAX_LANES];
+        int num_active;
+        uint32_t mask[LOCKSTEP_MAX_LANES] __attribute__((aligned(32)));
+
+        /* where each lane that left did, to finish from */
+        uint32_t left_registers[LOCKSTEP_MAX_LANES][NUM_REGISTERS];
+        uint32_t left_at[LOCKSTEP_MAX_LANES];
+        uint8_t has_left[LOCKSTEP_MAX_LANES];
+} Lockstep_group;
+
+
+static void run_group(Lockstep_group *group, Lockstep_stats *stats);
+
+static void leave(Lockstep_group *group, int lane,
+                  uint32_t program_counter);
+
+static inline int all_equal(Lockstep_group *group, uint32_t r,
+                           uint32_t value);
+
+static uint32_t jump_target(Lockstep_group *group, uint32_t rc);
+
+static inline int in_bounds(Lockstep_lane *machine, uint32_t seg_ID,
+                            uint32_t offset);
+
+static int segment_op(Lockstep_group *group, int lane, Um_opcode opcode,
+                      uint32_t rb, uint32_t rc);
+
+static inline void gather(Lockstep_group *group, int lane,
+                          uint32_t *registers);
+
+
+/*      lockstep_run
+ * Purpose: run every lane of a group to completion, in lockstep for as
+ *          long as they go the same way
+ * Expectations: every lane's all_segments has program mapped as its
+ *               segment 0, & nothing else; 1 <= num_lanes <=
+ *               LOCKSTEP_MAX_LANES
+ * Input: the program, its length in words, the lanes, how many, stats
+ *        to add to
+ * Output: N/A, void - end result: every lane has run its program to
+ *         the end, & has the status interpret would have given it (a
+ *         lane that faults only fails itself)
+ */
+void lockstep_run(uint32_t *program, uint32_t num_words,
+                  Lockstep_lane *lanes, int num_lanes,
+                  Lockstep_stats *stats)
+{
+        assert(program != NULL && lanes != NULL && stats != NULL);
+        assert(num_lanes >= 1 && num_lanes <= LOCKSTEP_MAX_LANES);
+
+        Lockstep_group group;
+        memset(&group, 0, sizeof(group));
+        group.num_vectors = (num_lanes + VECTOR_LANES - 1) / VECTOR_LANES;
+        group.program = program;
+        group.num_words = num_words;
+        group.lanes = lanes;
+        group.num_lanes = num_lanes;
+        for (int lane = 0; lane < num_lanes; lane++) {
+                group.active[lane] = lane;
+                group.mask[lane] = ~0u;
+        }
+        group.num_active = num_lanes;
+
+        run_group(&group, stats);
+
+        /* lanes that left finish one at a time, from where they left */
+        for (int lane = 0; lane < num_lanes; lane++) {
+                if (group.has_left[lane]) {
+                        lanes[lane].status =
+                                interpret_guarded(lanes[lane].all_segments,
+                                                  lanes[lane].io,
+                                                  group.left_registers[lane],
+                                                  group.left_at[lane], NULL);
+                        stats->left++;
+                }
+        }
+}
+
+
+/*
+ * a register of the current word, one slot per lane, & the same
+ * register as vectors
+ */
+#define REG(r) (group->registers[r])
+#define VEC(r) ((Lane_vector *)group->registers[r])
+
+/*
+ * lanes still in the group that satisfy the condition (on lane) leave
+ * it, to finish on their own from the given word
+ */
+#define LEAVE_IF(condition, program_counter) \
+        do { \
+                int kept = 0; \
+                for (int i = 0; i < group->num_active; i++) { \
+                        int lane = group->active[i]; \
+                        if (condition) { \
+                                leave(group, lane, program_counter); \
+                        } else { \
+                                group->active[kept++] = lane; \
+                        } \
+                } \
+                group->num_active = kept; \
+        } while (0)
+
+/* run the statement once for each lane still in the group */
+#define EACH_LANE(statement) \
+        do { \
+                for (int i = 0; i < group->num_active; i++) { \
+                        int lane = group->active[i]; \
+                        Lockstep_lane *machine = &group->lanes[lane]; \
+                        (void)machine; \
+                        statement; \
+                } \
+        } while (0)
+
+/*      run_group
+ * Purpose: run the group's words in lockstep until every lane has
+ *          halted or left
+ * Expectations: group is set up, with every lane in it at word 0
+ * Input: the group, stats to add to
+ * Output: N/A, void - end result: lanes that halted have their status;
+ *         the rest have left, with where to finish from
+ * Note: a lane leaves before the word it can't run with the others, so
+ *       interpret runs that word for it, just as it would have alone
+ */
+VECTOR_CLONES
+static void run_group(Lockstep_group *group, Lockstep_stats *stats)
+{
+        uint32_t program_counter = 0;
+        int num_vectors = group->num_vectors;
+        uint32_t registers[NUM_REGISTERS];
+        uint64_t words = 0, lane_words = 0;
+
+        while (group->num_active > 0) {
+                /* running off the end is for interpret to report */
+                if (program_counter >= group->num_words) {
+                        LEAVE_IF(1, program_counter);
+                        break;
+                }
+
+                uint32_t word = group->program[program_counter];
+                Um_opcode opcode = UM_OPCODE(word);
+                uint32_t ra = UM_RA(word), rb = UM_RB(word);
+                uint32_t rc = UM_RC(word);
+
+                switch (opcode) {
+                case CMOV:
+                        for (int v = 0; v < num_vectors; v++) {
+                                Lane_vector move = (Lane_vector)
+                                                   (VEC(rc)[v] != 0);
+                                VEC(ra)[v] = (VEC(rb)[v] & move) |
+                                             (VEC(ra)[v] & ~move);
+                        }
+                        break;
+                case SLOAD:
+                        LEAVE_IF(!in_bounds(&group->lanes[lane],
+                                            REG(rb)[lane], REG(rc)[lane]),
+                                 program_counter);
+                        EACH_LANE(gather(group, lane, registers);
+                                  segmented_load(machine->all_segments,
+                                                 registers, ra, rb, rc);
+                                  REG(ra)[lane] = registers[ra]);
+                        break;
+                case SSTORE:
+                        /* a store into its code takes it its own way */
+                        LEAVE_IF(REG(ra)[lane] == 0 ||
+                                 !in_bounds(&group->lanes[lane],
+                                            REG(ra)[lane], REG(rb)[lane]),
+                                 program_counter);
+                        EACH_LANE(gather(group, lane, registers);
+                                  segmented_store(machine->all_segments,
+                                                  registers, ra, rb, rc));
+                        break;
+                case ADD:
+                        for (int v = 0; v < num_vectors; v++) {
+                                VEC(ra)[v] = VEC(rb)[v] + VEC(rc)[v];
+                        }
+                        break;
+                case MUL:
+                        for (int v = 0; v < num_vectors; v++) {
+                                VEC(ra)[v] = VEC(rb)[v] * VEC(rc)[v];
+                        }
+                        break;
+                case DIV:
+                        /* 
+                         * AVX2 has no integer divide, so one lane at a
+                         * time (& dividing by 0 is a fault)
+                         */
+                        LEAVE_IF(REG(rc)[lane] == 0, program_counter);
+                        EACH_LANE(REG(ra)[lane] = REG(rb)[lane] /
+                                                  REG(rc)[lane]);
+                        break;
+                case NAND:
+                        for (int v = 0; v < num_vectors; v++) {
+                                VEC(ra)[v] = ~(VEC(rb)[v] & VEC(rc)[v]);
+                        }
+                        break;
+                case HALT:
+                        EACH_LANE(machine->status = EXIT_SUCCESS);
+                        words++;
+                        lane_words += group->num_active;
+                        group->num_active = 0;
+                        continue;
+                case ACTIVATE:
+                        LEAVE_IF(!segment_op(group, lane, opcode, rb, rc),
+                                 program_counter);
+                        break;
+                case INACTIVATE:
+                        /* unmapping its code would take it elsewhere */
+                        LEAVE_IF(REG(rc)[lane] == 0 ||
+                                 !segment_op(group, lane, opcode, rb, rc),
+                                 program_counter);
+                        break;
+                case OUT:
+                        EACH_LANE(output(machine->io, &REG(rc)[lane], 0));
+                        break;
+                case IN:
+                        EACH_LANE(input(machine->io, &REG(rc)[lane], 0));
+                        break;
+                case LOADP: {
+                        /* 
+                         * only a jump stays in the group, & only to
+                         * where the most lanes go
+                         */
+                        if (!all_equal(group, rb, 0)) {
+                                LEAVE_IF(REG(rb)[lane] != 0,
+                                         program_counter);
+                                if (group->num_active == 0) {
+                                        break;
+                                }
+                        }
+                        uint32_t target = REG(rc)[group->active[0]];
+                        if (!all_equal(group, rc, target)) {
+                                target = jump_target(group, rc);
+                                LEAVE_IF(REG(rc)[lane] != target,
+                                         REG(rc)[lane]);
+                        }
+                        words++;
+                        lane_words += group->num_active;
+                        program_counter = target;
+                        continue;
+                }
+                case LV: {
+                        Lane_vector value = { 0 };
+                        value += UM_LV_VAL(word);
+                        ra = UM_LV_RA(word);
+                        for (int v = 0; v < num_vectors; v++) {
+                                VEC(ra)[v] = value;
+                        }
+                        break;
+                }
+                default:
+                        /* not an instruction: interpret reports it */
+                        LEAVE_IF(1, program_counter);
+                        break;
+                }
+
+                /* Note: a word every lane left before isn't counted */
+                if (group->num_active > 0) {
+                        words++;
+                        lane_words += group->num_active;
+                }
+                program_counter++;
+        }
+
+        stats->words += words;
+        stats->lane_words += lane_words;
+}
+
+#undef LEAVE_IF
+#undef EACH_LANE
+
+
+/*      leave
+ * Purpose: take a lane out of the group, to finish on its own
+ * Expectations: lane is still in the group (the caller takes it off
+ *               the list of active lanes)
+ * Input: the group, index of the lane, word it goes on from
+ * Output: N/A, void - end result: lane's registers & program counter
+ *         are kept for interpret
+ */
+static void leave(Lockstep_group *group, int lane,
+                  uint32_t program_counter)
+{
+        gather(group, lane, group->left_registers[lane]);
+        group->left_at[lane] = program_counter;
+        group->has_left[lane] = 1;
+        group->mask[lane] = 0;
+}
+
+/*      all_equal
+ * Purpose: check a register against a value in every lane still in the
+ *          group at once
+ * Expectations: N/A
+ * Input: the group, the register, the value
+ * Output: 1 if the register holds the value in every lane still in
+ *         the group, else 0
+ */
+static inline int all_equal(Lockstep_group *group, uint32_t r,
+                           uint32_t value)
+{
+        Lane_vector differ = { 0 };
+        for (int v = 0; v < group->num_vectors; v++) {
+                differ |= (VEC(r)[v] ^ value) &
+                          ((Lane_vector *)group->mask)[v];
+        }
+
+        uint32_t any = 0;
+        for (int lane = 0; lane < VECTOR_LANES; lane++) {
+                any |= differ[lane];
+        }
+        return any == 0;
+}
+
+/*      jump_target
+ * Purpose: pick where the group goes on a Load Program that only jumps
+ * Expectations: at least one lane is still in the group
+ * Input: the group, register holding each lane's target
+ * Output: the target the most lanes share (the first lane's on a tie)
+ * Note: quadratic, so only for when the lanes disagree
+ */
+static uint32_t jump_target(Lockstep_group *group, uint32_t rc)
+{
+        uint32_t *targets = REG(rc);
+        uint32_t best = targets[group->active[0]];
+        int best_count = 0;
+        for (int i = 0; i < group->num_active; i++) {
+                uint32_t target = targets[group->active[i]];
+                int count = 0;
+                for (int j = 0; j < group->num_active; j++) {
+                        count += targets[group->active[j]] == target;
+                }
+                if (count > best_count) {
+                        best = target;
+                        best_count = count;
+                }
+        }
+        return best;
+}
+
+/*      in_bounds
+ * Purpose: check that a lane's load or store has a word to go to
+ * Expectations: N/A
+ * Input: the lane's machine, segment ID, offset into it
+ * Output: 1 if the segment is mapped & has a word at offset, else 0
+ */
+static inline int in_bounds(Lockstep_lane *machine, uint32_t seg_ID,
+                            uint32_t offset)
+{
+        return seg_mapped(machine->all_segments, seg_ID) &&
+               offset < seg_length(machine->all_segments, seg_ID);
+}
+
+/*      segment_op
+ * Purpose: run one lane's Map or Unmap Segment, unless it would fault
+ * Expectations: lane is still in the group
+ * Input: the group, index of the lane, ACTIVATE or INACTIVATE, the
+ *        word's rb & rc
+ * Output: 1 if it ran, else 0 (out of memory, or unmapping what isn't
+ *         mapped), with the lane as it was
+ * Note: a lane that can't run it leaves, so interpret runs it again,
+ *       alone, & faults there just as it would have without the group
+ */
+static int segment_op(Lockstep_group *group, int lane, Um_opcode opcode,
+                      uint32_t rb, uint32_t rc)
+{
+        Lockstep_lane *machine = &group->lanes[lane];
+        uint32_t registers[NUM_REGISTERS];
+        gather(group, lane, registers);
+
+        jmp_buf fault;
+        jmp_buf *outer = guest_fault_exit;
+        guest_fault_exit = &fault;
+        if (setjmp(fault) != 0) {
+                guest_fault_exit = outer;
+                return 0;
+        }
+
+        if (opcode == ACTIVATE) {
+                map_segment(machine->all_segments, registers, rb, rc);
+                REG(rb)[lane] = registers[rb];
+        } else {
+                unmap_segment(machine->all_segments, registers, rc);
+        }
+        guest_fault_exit = outer;
+        return 1;
+}
+
+/*      gather
+ * Purpose: copy one lane's registers out of the group
+ * Expectations: N/A
+ * Input: the group, index of the lane, array of 8 registers to fill
+ * Output: N/A, void - end result: registers holds the lane's
+ */
+static inline void gather(Lockstep_group *group, int lane,
+                          uint32_t *registers)
+{
+        for (int r = 0; r < NUM_REGISTERS; r++) {
+                registers[r] = REG(r)[lane];
+        }
+}
+
+#undef REG
+#undef VEC
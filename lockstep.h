@@ -0,0 +1,61 @@
+/*
+ *              ** lockstep.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Lockstep interface: runs a group of machines (lanes),
+ *             all starting the same program, in lockstep, one word at a
+ *             time for all of them, with their registers laid out as
+ *             one array per register (./um-batch --lockstep <lanes>)
+ *
+ *             ADD, MUL, NAND, CMOV & LV then run across lanes as vector
+ *             operations (AVX2 where the CPU has it), & the rest lane by
+ *             lane. A lane leaves the group whenever it would go another
+ *             way than the rest: a Load Program jumping elsewhere, or
+ *             loading new code, a store into its segment 0, or anything
+ *             that would fault. It then finishes on its own, in the
+ *             interpreter, from exactly where it left.
+ *
+ */
+
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "segment.h"
+#include "umio.h"
+
+
+/* most lanes in one group */
+#define LOCKSTEP_MAX_LANES 64
+
+/* one machine in a group: its own segments & I/O, & how its run ended */
+typedef struct Lockstep_lane {
+        Segments all_segments;  /* segment 0: the group's program */
+        Um_io io;
+        int status;             /* as interpret would return */
+} Lockstep_lane;
+
+/* what a group did, added to by lockstep_run */
+typedef struct Lockstep_stats {
+        uint64_t words;         /* run in lockstep */
+        uint64_t lane_words;    /* run in lockstep, summed over lanes */
+        uint64_t left;          /* lanes that finished on their own */
+} Lockstep_stats;
+
+
+/*
+ * Note: program is the group's segment 0, shared (see map_pinned_seg)
+ *       by every lane's all_segments & never written through it; runs
+ *       every lane to completion from word 0 & all registers 0
+ */
+void lockstep_run(uint32_t *program, uint32_t num_words,
+                  Lockstep_lane *lanes, int num_lanes,
+                  Lockstep_stats *stats);
+
+
+#endif /* LOCKSTEP_H */
@@ -0,0 +1,39 @@
+/*
+ *              ** native.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Native interface,
+ *             with all relevant functions and libraries
+ *
+ */
+
+#include <unistd.h>
+
+#include "native.h"
+
+
+/*      native_main
+ * Purpose: set up a machine whose segment 0 is the translated program's
+ *          own words, run the translation on it, & clean up
+ * Expectations: words are preceded by a SEG_REFS of SEG_PINNED (um2c
+ *               emits them that way) & are the words run was made from
+ * Input: the program's words, how many, the translated program
+ * Output: EXIT_SUCCESS on HALT, EXIT_FAILURE on any fault
+ */
+int native_main(uint32_t *words, uint32_t num_words, Native_program run)
+{
+        assert(words != NULL && run != NULL);
+
+        /* Note: pinned, so a store into the program copies it out */
+        Segments all_segments = segments_initialize();
+        map_pinned_seg(all_segments, words, num_words);
+        Um_io io = umio_new(STDIN_FILENO, STDOUT_FILENO, 0, 0, 0);
+
+        int status = run(all_segments, io);
+
+        umio_free(io);
+        segments_free(all_segments);
+        return status;
+}
@@ -0,0 +1,63 @@
+/*
+ *              ** native.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Native interface: the runtime that programs translated
+ *             to C by um2c are compiled against
+ *
+ *             A translated program is one function, with the 8 um
+ *             registers in local variables & a label per word. It runs
+ *             on the same Segments & Um_io as um, & hands the machine
+ *             to the interpreter for good once the program stores into
+ *             segment 0 or loads any other segment as code.
+ *
+ */
+
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "segment.h"
+#include "umio.h"
+#include "interpreter.h"
+
+
+/* the translated program: returns EXIT_SUCCESS or EXIT_FAILURE */
+typedef int (*Native_program)(Segments all_segments, Um_io io);
+
+int native_main(uint32_t *words, uint32_t num_words, Native_program run);
+
+
+/*
+ * Helpers for translated code
+ * Note: the same semantics as segmented_store & output, but taking
+ *       register values rather than indices
+ */
+static inline void native_store(Segments all_segments,
+                                uint32_t seg_ID,
+                                uint32_t offset,
+                                uint32_t value)
+{
+        uint32_t *segment = seg_words(all_segments, seg_ID);
+
+        /* first write to shared (or pinned) words makes a copy */
+        if (SEG_REFS(segment) > 1) {
+                segment = unshare_seg(all_segments, seg_ID);
+        }
+        segment[offset] = value;
+}
+
+static inline void native_output(Um_io io, uint32_t value)
+{
+        if (value <= 255) {
+                umio_put(io, value);
+        }
+}
+
+
+#endif /* NATIVE_H */
@@ -0,0 +1,112 @@
+/*
+ *              ** profile.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Profile interface: the counters
+ *             themselves & the report printed once the program stops
+ *
+ *             Only linked into um-prof, where everything is built with
+ *             UM_PROFILE defined.
+ *
+ */
+
+#include "profile.h"
+
+
+Um_profile um_profile = { .current = -1 };
+
+/* names for the report, indexed by opcode */
+static const char *const opcode_names[16] = {
+        "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+        "MAP", "UNMAP", "OUT", "IN", "LOADP", "LV", "(14)", "(15)"
+};
+
+
+/*      profile_stop
+ * Purpose: charge the time since the last dispatch to the handler that
+ *          was running, once the program has stopped
+ * Expectations: N/A
+ * Input: N/A
+ * Output: N/A, void - end result: no handler is being timed
+ */
+void profile_stop()
+{
+        if (um_profile.current >= 0) {
+                um_profile.cycles[um_profile.current] +=
+                        profile_timestamp() - um_profile.start;
+                um_profile.current = -1;
+        }
+}
+
+/*      profile_report
+ * Purpose: print the counters: a table of opcodes, busiest first, then
+ *          the segment & Load Program counts & the allocator's stats
+ * Expectations: fp is open for writing
+ * Input: struct holding the segment table & unmapped IDs, whether the
+ *        program ran under the JIT, stream to print to
+ * Output: N/A, void - end result: report written to fp
+ */
+void profile_report(Segments all_segments, int jit, FILE *fp)
+{
+        uint64_t total_count = 0;
+        uint64_t total_cycles = 0;
+        int order[16];
+
+        for (int opcode = 0; opcode < 16; opcode++) {
+                total_count += um_profile.count[opcode];
+                total_cycles += um_profile.cycles[opcode];
+                order[opcode] = opcode;
+        }
+
+        /* insertion sort: busiest (most cycles) first */
+        for (int i = 1; i < 16; i++) {
+                int opcode = order[i];
+                int j = i;
+                for (; j > 0 && um_profile.cycles[order[j - 1]] <
+                                um_profile.cycles[opcode]; j--) {
+                        order[j] = order[j - 1];
+                }
+                order[j] = opcode;
+        }
+
+        fprintf(fp, "um profile\n");
+        if (jit) {
+                /* translated code does not pass through the dispatch */
+                fprintf(fp, "  (--jit: no per-opcode counts)\n");
+        } else {
+                fprintf(fp, "  %-7s %14s %6s %16s %6s %9s\n", "opcode",
+                        "count", "%", "cycles", "%", "cyc/inst");
+                for (int i = 0; i < 16; i++) {
+                        int opcode = order[i];
+                        uint64_t count = um_profile.count[opcode];
+                        uint64_t cycles = um_profile.cycles[opcode];
+                        if (count == 0) {
+                                continue;
+                        }
+                        fprintf(fp, "  %-7s %14llu %5.1f%% %16llu %5.1f%% "
+                                    "%9.1f\n", opcode_names[opcode],
+                                (unsigned long long)count,
+                                100.0 * count / total_count,
+                                (unsigned long long)cycles,
+                                total_cycles == 0 ? 0.0 :
+                                        100.0 * cycles / total_cycles,
+                                (double)cycles / count);
+                }
+                fprintf(fp, "  %-7s %14llu %6s %16llu\n", "total",
+                        (unsigned long long)total_count, "",
+                        (unsigned long long)total_cycles);
+        }
+
+        fprintf(fp, "  segments: %llu maps (%llu words), %llu unmaps\n",
+                (unsigned long long)um_profile.maps,
+                (unsigned long long)um_profile.mapped_words,
+                (unsigned long long)um_profile.unmaps);
+        fprintf(fp, "  load program: %llu jumps, %llu loads (%llu words)\n",
+                (unsigned long long)um_profile.loadp_jumps,
+                (unsigned long long)um_profile.loadp_loads,
+                (unsigned long long)um_profile.loaded_words);
+        fprintf(fp, "  ");
+        segments_print_stats(all_segments, fp);
+}
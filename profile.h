@@ -0,0 +1,100 @@
+/*
+ *              ** profile.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Profile interface: per-opcode execution counts & cycles,
+ *             plus segment & Load Program counters, for the instrumented
+ *             build (make um-prof, which defines UM_PROFILE)
+ *
+ *             Without UM_PROFILE every PROFILE_* macro expands to nothing,
+ *             so the default build carries no instrumentation at all.
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+
+#ifdef UM_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#include "segment.h"
+
+/*
+ * counters for one run of the emulator
+ * Note: cycles are charged to the handler that was running when the
+ *       next one was dispatched, so they include the dispatch itself
+ */
+typedef struct Um_profile {
+        uint64_t count[16];             /* instructions run, by opcode */
+        uint64_t cycles[16];            /* timestamp ticks, by opcode */
+        uint64_t maps;                  /* Map Segment instructions */
+        uint64_t mapped_words;          /* ... & the words they asked for */
+        uint64_t unmaps;                /* Unmap Segment instructions */
+        uint64_t loadp_jumps;           /* Load Program of segment 0 */
+        uint64_t loadp_loads;           /* ... of any other segment */
+        uint64_t loaded_words;          /* ... & the words they brought in */
+
+        int current;                    /* opcode running now, or -1 */
+        uint64_t start;                 /* timestamp when it started */
+} Um_profile;
+
+extern Um_profile um_profile;
+
+void profile_stop();
+
+void profile_report(Segments all_segments, int jit, FILE *fp);
+
+/* Note: the cycle counter's ticks, or nanoseconds off x86 */
+static inline uint64_t profile_timestamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/*
+ * charge the time since the last dispatch to the handler that was
+ * running, then count & start timing the next one
+ * Note: inline, since it runs once per emulated instruction
+ */
+static inline void profile_dispatch(int opcode)
+{
+        uint64_t now = profile_timestamp();
+        if (um_profile.current >= 0) {
+                um_profile.cycles[um_profile.current] += now - um_profile.start;
+        }
+        um_profile.count[opcode]++;
+        um_profile.current = opcode;
+        um_profile.start = now;
+}
+
+#define PROFILE_DISPATCH(opcode) profile_dispatch(opcode)
+#define PROFILE_STOP() profile_stop()
+#define PROFILE_COUNT(counter, amount) (um_profile.counter += (amount))
+
+#else
+
+#define PROFILE_DISPATCH(opcode) ((void)0)
+#define PROFILE_STOP() ((void)0)
+#define PROFILE_COUNT(counter, amount) ((void)0)
+
+#endif /* UM_PROFILE */
+
+
+#endif /* PROFILE_H */
@@ -0,0 +1,216 @@
+/*
+ *              ** sampler.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Sampler interface,
+ *             with all relevant functions and libraries
+ *
+ *             Samples go into a fixed buffer, filled by the handler. If
+ *             it fills, every other sample is dropped & from then on
+ *             only every other tick is kept (& so on), so however long
+ *             the run, the samples stay spread evenly over all of it.
+ *
+ *             Each line of the report is one stack & its ticks:
+ *                 um;code <n>;words <first>-<last>;<word> <ticks>
+ *             where code <n> is segment 0 after n Load Programs of other
+ *             segments, & each range is SAMPLE_RANGE_WORDS words, so a
+ *             flame graph shows hot ranges, with hot words on top.
+ *
+ */
+
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "assert.h"
+#include "sampler.h"
+
+
+/* 
+ * samples per second of CPU time
+ * Note: the kernel only checks CPU timers on its scheduler tick, so
+ *       this is an upper bound (often 250 or so in practice)
+ */
+#define SAMPLE_HZ 1000
+
+/* samples kept before thinning out (8 bytes each, touched as used) */
+#define SAMPLE_CAPACITY (1 << 20)
+
+/* words per range of the report (a power of 2) */
+#define SAMPLE_RANGE_WORDS 256
+
+typedef struct Sample {
+        uint32_t code_loads;
+        uint32_t pc;
+} Sample;
+
+/*
+ * everything the handler touches
+ * Note: only written by the handler while the timer runs, & only read
+ *       once it's stopped
+ */
+static struct Sampler {
+        Sample *samples;
+        uint32_t count;
+        uint32_t stride;        /* ticks per kept sample */
+        uint32_t skipped;       /* ticks since the last kept one */
+        uint64_t ticks;         /* all of them, kept or not */
+        uint64_t elsewhere;     /* ticks on threads not interpreting */
+} sampler;
+
+__thread Sample_point sample_point;
+
+
+static void take_sample(int signum);
+
+static int compare_samples(const void *first, const void *second);
+
+
+/*      sampler_start
+ * Purpose: start sampling the guest every SIGPROF
+ * Expectations: not already started
+ * Input: N/A, none
+ * Output: N/A, void - end result: handler installed & timer running
+ * Note: the calling thread is marked as running the interpreter
+ */
+void sampler_start()
+{
+        assert(sampler.samples == NULL);
+        sampler.samples = calloc(SAMPLE_CAPACITY, sizeof(Sample));
+        assert(sampler.samples != NULL);
+        sampler.stride = 1;
+        sample_point.running = 1;
+
+        /* Note: SA_RESTART, so the guest's I/O never sees EINTR */
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = take_sample;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        int installed = sigaction(SIGPROF, &action, NULL);
+        assert(installed == 0);
+        (void)installed;
+
+        struct itimerval timer;
+        timer.it_interval.tv_sec = 0;
+        timer.it_interval.tv_usec = 1000000 / SAMPLE_HZ;
+        timer.it_value = timer.it_interval;
+        int armed = setitimer(ITIMER_PROF, &timer, NULL);
+        assert(armed == 0);
+        (void)armed;
+}
+
+/*      sampler_stop
+ * Purpose: stop sampling, keeping what has been sampled so far
+ * Expectations: sampler_start was called
+ * Input: N/A, none
+ * Output: N/A, void - end result: timer stopped & SIGPROF ignored
+ */
+void sampler_stop()
+{
+        struct itimerval timer;
+        memset(&timer, 0, sizeof(timer));
+        int disarmed = setitimer(ITIMER_PROF, &timer, NULL);
+        assert(disarmed == 0);
+        (void)disarmed;
+        signal(SIGPROF, SIG_IGN);
+        sample_point.running = 0;
+}
+
+/*      sampler_report
+ * Purpose: write the samples as collapsed stacks, one line per word
+ *          sampled, & a line summing them up
+ * Expectations: sampler_stop was called, both streams are open
+ * Input: stream for the stacks, stream for the summary
+ * Output: N/A, void - end result: report written & samples freed
+ */
+void sampler_report(FILE *out, FILE *summary)
+{
+        assert(out != NULL && summary != NULL);
+        assert(sampler.samples != NULL);
+
+        qsort(sampler.samples, sampler.count, sizeof(Sample),
+              compare_samples);
+
+        /* Note: sorted, so each word's samples are one run */
+        for (uint32_t first = 0, last; first < sampler.count; first = last) {
+                Sample *sample = &sampler.samples[first];
+                for (last = first + 1; last < sampler.count &&
+                     compare_samples(sample, &sampler.samples[last]) == 0;
+                     last++) {
+                }
+
+                uint32_t range = sample->pc & ~(SAMPLE_RANGE_WORDS - 1u);
+                fprintf(out, "um;code %u;words %08x-%08x;%08x %llu\n",
+                        sample->code_loads, range,
+                        range + SAMPLE_RANGE_WORDS - 1, sample->pc,
+                        (unsigned long long)(last - first) * sampler.stride);
+        }
+        if (sampler.elsewhere > 0) {
+                fprintf(out, "um;other threads %llu\n",
+                        (unsigned long long)sampler.elsewhere);
+        }
+
+        fprintf(summary, "sample-profile: %llu ticks (1 in %u kept), "
+                         "%llu Load Programs, %u loading code\n",
+                (unsigned long long)sampler.ticks, sampler.stride,
+                (unsigned long long)sample_point.loadps,
+                sample_point.code_loads);
+
+        free(sampler.samples);
+        sampler.samples = NULL;
+}
+
+
+/*      take_sample
+ * Purpose: SIGPROF handler: record where the guest is
+ * Expectations: sampler_start was called
+ * Input: signal number (unused)
+ * Output: N/A, void - end result: a sample kept, or the tick counted
+ * Note: async-signal-safe, as it only reads & writes memory
+ */
+static void take_sample(int signum)
+{
+        (void)signum;
+        sampler.ticks++;
+
+        if (!sample_point.running) {
+                sampler.elsewhere++;
+                return;
+        }
+        if (++sampler.skipped < sampler.stride) {
+                return;
+        }
+        sampler.skipped = 0;
+
+        /* full: keep every other sample, & from now on every other tick */
+        if (sampler.count == SAMPLE_CAPACITY) {
+                for (uint32_t i = 0; i < SAMPLE_CAPACITY / 2; i++) {
+                        sampler.samples[i] = sampler.samples[2 * i + 1];
+                }
+                sampler.count = SAMPLE_CAPACITY / 2;
+                sampler.stride *= 2;
+        }
+
+        Sample *sample = &sampler.samples[sampler.count++];
+        sample->code_loads = sample_point.code_loads;
+        sample->pc = sample_point.pc;
+}
+
+/*      compare_samples
+ * Purpose: order samples by code, then by word, for qsort
+ * Expectations: both point to Samples
+ * Input: the two samples
+ * Output: negative, 0, or positive, as the first sorts before, with,
+ *         or after the second
+ */
+static int compare_samples(const void *first, const void *second)
+{
+        const Sample *a = first, *b = second;
+        if (a->code_loads != b->code_loads) {
+                return a->code_loads < b->code_loads ? -1 : 1;
+        }
+        return (a->pc > b->pc) - (a->pc < b->pc);
+}
@@ -0,0 +1,60 @@
+/*
+ *              ** sampler.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Sampler interface: a statistical profiler of the guest
+ *             program (./um --sample-profile <file>), which samples the
+ *             word of segment 0 being run on every SIGPROF & writes a
+ *             histogram of them as collapsed stacks for flamegraph.pl
+ *
+ *             The interpreter publishes its program counter (& counts
+ *             Load Programs) in sample_point as it runs, at the cost of
+ *             one store per instruction; the signal handler only reads
+ *             it. The timer counts CPU time, so time blocked on Input
+ *             isn't sampled.
+ *
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+
+/*
+ * where this thread's machine is, as seen by the signal handler
+ * Note: volatile, so every store reaches memory before the next
+ *       instruction runs, however the loop is optimized
+ */
+typedef struct Sample_point {
+        volatile uint32_t pc;           /* word of segment 0 running */
+        volatile uint32_t code_loads;   /* LOADPs of another segment */
+        volatile uint64_t loadps;       /* all LOADPs */
+        volatile int running;           /* an interpreter is on this thread */
+} Sample_point;
+
+extern __thread Sample_point sample_point;
+
+/* Note: libum (UM_LIBRARY) has no sampler, so publishes nothing */
+#ifdef UM_LIBRARY
+#define SAMPLE_PC(program_counter) ((void)0)
+#define SAMPLE_LOADP(new_code) ((void)0)
+#else
+#define SAMPLE_PC(program_counter) (sample_point.pc = (program_counter))
+#define SAMPLE_LOADP(new_code) \
+        (sample_point.loadps++, sample_point.code_loads += (new_code))
+#endif
+
+
+void sampler_start();
+
+void sampler_stop();
+
+void sampler_report(FILE *out, FILE *summary);
+
+
+#endif /* SAMPLER_H */
@@ -0,0 +1,396 @@
+/*
+ *              ** segbench.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Segment microbenchmarks: times map_seg, unmap_seg,
+ *             segmented_load/segmented_store & load_program directly,
+ *             with no interpreter in the way, & prints one JSON object
+ *             per benchmark with ns/op, allocations/op, & the spread
+ *             over its repetitions
+ *
+ *             Usage: ./segbench [scale] [benchmark name...]
+ *
+ *             Every repetition gets a fresh Segments, is set up &
+ *             warmed up (a tenth of its ops, untimed), then timed.
+ *             "allocs" counts segment allocations (segment_new calls),
+ *             & "sys_allocs" those that reached calloc or mmap (new
+ *             slabs & large segments), from the pool's own counters.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "assert.h"
+#include "segment.h"
+#include "instructions.h"
+
+
+/* timed repetitions of each benchmark; median, min & max are reported */
+#define BENCH_REPS 7
+
+/* segments kept live by the table-wide benchmarks */
+#define LIVE_SEGS 4096
+
+/* words in each of those segments, for load & store */
+#define LIVE_WORDS 256
+
+/* precomputed (segment, offset) pairs, cycled through by access ops */
+#define NUM_ACCESSES (64 * 1024)
+
+/* the state a benchmark runs on: a fresh machine per repetition */
+typedef struct Bench_state {
+        Segments all_segments;
+        uint32_t registers[8];
+        uint32_t live[LIVE_SEGS];               /* IDs of live segments */
+        uint32_t *accesses;                     /* pairs, for access ops */
+        uint64_t seed;
+        uint32_t param;                         /* per benchmark */
+} Bench_state;
+
+typedef struct Seg_bench {
+        const char *name;
+        uint64_t ops;                           /* at scale 1 */
+        uint32_t param;
+        void (*setup)(Bench_state *state);
+        void (*run)(Bench_state *state, uint64_t ops);
+} Seg_bench;
+
+
+static uint32_t next_random(Bench_state *state);
+
+static void setup_empty(Bench_state *state);
+static void setup_live(Bench_state *state);
+static void setup_sequential(Bench_state *state);
+static void setup_random(Bench_state *state);
+static void setup_program(Bench_state *state);
+
+static void run_churn(Bench_state *state, uint64_t ops);
+static void run_recycle(Bench_state *state, uint64_t ops);
+static void run_load(Bench_state *state, uint64_t ops);
+static void run_store(Bench_state *state, uint64_t ops);
+static void run_loadp_share(Bench_state *state, uint64_t ops);
+static void run_loadp_copy(Bench_state *state, uint64_t ops);
+
+static void run_bench(const Seg_bench *bench, uint64_t scale);
+
+static int compare_doubles(const void *a, const void *b);
+
+
+/*
+ * The suite: each op is one map & unmap (churn, recycle), one load or
+ * store (access), or one Load Program (loadp), which for loadp_copy is
+ * followed by a store into segment 0 that forces the copy
+ * Note: param is the largest segment size for churn (sizes cycle from
+ *       1 up to it), & the source segment's size for loadp
+ */
+static const Seg_bench BENCHES[] = {
+        { "churn_tiny",     4000000,     8, setup_empty,      run_churn },
+        { "churn_mixed",    2000000,  1024, setup_empty,      run_churn },
+        { "churn_large",      20000, 65536, setup_empty,      run_churn },
+        { "recycle",        2000000,    16, setup_live,       run_recycle },
+        { "load_seq",      20000000,     0, setup_sequential, run_load },
+        { "store_seq",     20000000,     0, setup_sequential, run_store },
+        { "load_random",   20000000,     0, setup_random,     run_load },
+        { "store_random",  20000000,     0, setup_random,     run_store },
+        { "loadp_share",    4000000,    16, setup_program,    run_loadp_share },
+        { "loadp_small",    2000000,    16, setup_program,    run_loadp_copy },
+        { "loadp_large",       5000, 65536, setup_program,    run_loadp_copy },
+};
+
+#define NUM_BENCHES (sizeof(BENCHES) / sizeof(BENCHES[0]))
+
+
+/*      main
+ * Purpose: run every benchmark (or just the ones named), printing one
+ *          line of JSON for each
+ * Expectations: N/A
+ * Input: number of command line arguments, content of arguments
+ * Output: EXIT_SUCCESS, or EXIT_FAILURE if a name matches no benchmark
+ */
+int main(int argc, char *argv[])
+{
+        uint64_t scale = 1;
+        int arg = 1;
+        if (arg < argc && argv[arg][0] >= '0' && argv[arg][0] <= '9') {
+                scale = strtoull(argv[arg++], NULL, 10);
+        }
+        if (scale == 0) {
+                fprintf(stderr, "Usage: ./segbench [scale] "
+                                "[benchmark name...]\n");
+                exit(EXIT_FAILURE);
+        }
+
+        int status = EXIT_SUCCESS;
+        if (arg == argc) {
+                for (size_t i = 0; i < NUM_BENCHES; i++) {
+                        run_bench(&BENCHES[i], scale);
+                }
+        }
+        for (; arg < argc; arg++) {
+                size_t i = 0;
+                while (i < NUM_BENCHES &&
+                       strcmp(BENCHES[i].name, argv[arg]) != 0) {
+                        i++;
+                }
+                if (i == NUM_BENCHES) {
+                        fprintf(stderr, "segbench: no benchmark %s\n",
+                                argv[arg]);
+                        status = EXIT_FAILURE;
+                } else {
+                        run_bench(&BENCHES[i], scale);
+                }
+        }
+        return status;
+}
+
+
+/*      run_bench
+ * Purpose: set up, warm up, & time one benchmark BENCH_REPS times, then
+ *          print its results
+ * Expectations: bench is one of BENCHES
+ * Input: the benchmark, how many times its usual number of ops to run
+ * Output: N/A, void - end result: one line of JSON on stdout
+ */
+static void run_bench(const Seg_bench *bench, uint64_t scale)
+{
+        uint64_t ops = bench->ops * scale;
+        double ns_per_op[BENCH_REPS];
+        double sorted[BENCH_REPS];
+        Segment_pool_stats before, after;
+
+        for (int rep = 0; rep < BENCH_REPS; rep++) {
+                Bench_state state;
+                memset(&state, 0, sizeof(state));
+                state.all_segments = segments_initialize();
+                state.seed = 0x9e3779b97f4a7c15ULL + rep;
+                state.param = bench->param;
+
+                bench->setup(&state);
+                bench->run(&state, ops / 10);
+
+                before = segments_pool_stats(state.all_segments);
+                struct timespec start, end;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                bench->run(&state, ops);
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                after = segments_pool_stats(state.all_segments);
+
+                double ns = (end.tv_sec - start.tv_sec) * 1e9 +
+                            (end.tv_nsec - start.tv_nsec);
+                ns_per_op[rep] = ns / ops;
+
+                free(state.accesses);
+                segments_free(state.all_segments);
+        }
+
+        /* spread over the repetitions */
+        double mean = 0.0, variance = 0.0;
+        for (int rep = 0; rep < BENCH_REPS; rep++) {
+                mean += ns_per_op[rep] / BENCH_REPS;
+        }
+        for (int rep = 0; rep < BENCH_REPS; rep++) {
+                double diff = ns_per_op[rep] - mean;
+                variance += diff * diff / (BENCH_REPS - 1);
+        }
+        memcpy(sorted, ns_per_op, sizeof(sorted));
+        qsort(sorted, BENCH_REPS, sizeof(sorted[0]), compare_doubles);
+
+        /* Note: allocations are the same every repetition, so the last's */
+        uint64_t allocs = (after.small_allocs + after.large_allocs) -
+                          (before.small_allocs + before.large_allocs);
+        uint64_t sys_allocs = (after.slabs + after.large_allocs) -
+                              (before.slabs + before.large_allocs);
+
+        printf("{\"benchmark\": \"%s\", \"ops\": %llu, \"reps\": %d, "
+               "\"ns_per_op\": %.2f, \"ns_min\": %.2f, \"ns_max\": %.2f, "
+               "\"cv_pct\": %.1f, \"allocs_per_op\": %.4f, "
+               "\"sys_allocs_per_op\": %.6f}\n",
+               bench->name, (unsigned long long)ops, BENCH_REPS,
+               sorted[BENCH_REPS / 2], sorted[0], sorted[BENCH_REPS - 1],
+               100.0 * sqrt(variance) / mean, (double)allocs / ops,
+               (double)sys_allocs / ops);
+        fflush(stdout);
+}
+
+
+/*      next_random
+ * Purpose: xorshift64*, so runs are repeatable & cheap next to the ops
+ * Expectations: state's seed is not 0
+ * Input: benchmark state
+ * Output: 32 pseudo-random bits
+ */
+static uint32_t next_random(Bench_state *state)
+{
+        state->seed ^= state->seed >> 12;
+        state->seed ^= state->seed << 25;
+        state->seed ^= state->seed >> 27;
+        return (state->seed * 0x2545f4914f6cdd1dULL) >> 32;
+}
+
+
+/*
+ * Setups: every machine gets a segment 0, as um's always has one
+ */
+
+/* nothing but segment 0 */
+static void setup_empty(Bench_state *state)
+{
+        map_seg(state->all_segments, 1);
+}
+
+/* LIVE_SEGS small segments, for recycle to unmap & map again */
+static void setup_live(Bench_state *state)
+{
+        setup_empty(state);
+        for (int i = 0; i < LIVE_SEGS; i++) {
+                state->live[i] = map_seg(state->all_segments, state->param);
+        }
+}
+
+/* LIVE_SEGS segments of LIVE_WORDS, & every word of them in order */
+static void setup_sequential(Bench_state *state)
+{
+        setup_empty(state);
+        for (int i = 0; i < LIVE_SEGS; i++) {
+                state->live[i] = map_seg(state->all_segments, LIVE_WORDS);
+        }
+
+        state->accesses = malloc(sizeof(*state->accesses) * 2 *
+                                 NUM_ACCESSES);
+        assert(state->accesses != NULL);
+        for (uint32_t i = 0; i < NUM_ACCESSES; i++) {
+                uint32_t word = i % (LIVE_SEGS * LIVE_WORDS);
+                state->accesses[2 * i] = state->live[word / LIVE_WORDS];
+                state->accesses[2 * i + 1] = word % LIVE_WORDS;
+        }
+}
+
+/* the same segments, but words picked at random across all of them */
+static void setup_random(Bench_state *state)
+{
+        setup_sequential(state);
+        for (uint32_t i = 0; i < NUM_ACCESSES; i++) {
+                state->accesses[2 * i] =
+                        state->live[next_random(state) % LIVE_SEGS];
+                state->accesses[2 * i + 1] = next_random(state) % LIVE_WORDS;
+        }
+}
+
+/* segment 0, & a segment of param words to load as the program */
+static void setup_program(Bench_state *state)
+{
+        setup_empty(state);
+        state->live[0] = map_seg(state->all_segments, state->param);
+}
+
+
+/*
+ * Runs: each does ops of its kind on the state its setup left
+ */
+
+/* map a segment (sizes cycling from 1 up to param) & unmap it */
+static void run_churn(Bench_state *state, uint64_t ops)
+{
+        Segments all_segments = state->all_segments;
+        uint32_t size = 1;
+
+        for (uint64_t op = 0; op < ops; op++) {
+                uint32_t seg_ID = map_seg(all_segments, size);
+                unmap_seg(all_segments, seg_ID);
+                size = size == state->param ? 1 : size + 1;
+        }
+}
+
+/* unmap a random live segment, & map another (which reuses its ID) */
+static void run_recycle(Bench_state *state, uint64_t ops)
+{
+        Segments all_segments = state->all_segments;
+
+        for (uint64_t op = 0; op < ops; op++) {
+                uint32_t slot = next_random(state) % LIVE_SEGS;
+                unmap_seg(all_segments, state->live[slot]);
+                state->live[slot] = map_seg(all_segments, state->param);
+        }
+}
+
+/* segmented_load through the precomputed pairs */
+static void run_load(Bench_state *state, uint64_t ops)
+{
+        Segments all_segments = state->all_segments;
+        uint32_t *registers = state->registers;
+        uint32_t sum = 0;
+
+        for (uint64_t op = 0; op < ops; op++) {
+                uint32_t *access = &state->accesses[2 * (op % NUM_ACCESSES)];
+                registers[1] = access[0];
+                registers[2] = access[1];
+                segmented_load(all_segments, registers, 0, 1, 2);
+                sum += registers[0];
+        }
+
+        /* Note: keeps the loads from being optimized away */
+        registers[3] = sum;
+}
+
+/* segmented_store through the precomputed pairs */
+static void run_store(Bench_state *state, uint64_t ops)
+{
+        Segments all_segments = state->all_segments;
+        uint32_t *registers = state->registers;
+
+        for (uint64_t op = 0; op < ops; op++) {
+                uint32_t *access = &state->accesses[2 * (op % NUM_ACCESSES)];
+                registers[0] = access[0];
+                registers[1] = access[1];
+                registers[2] = op;
+                segmented_store(all_segments, registers, 0, 1, 2);
+        }
+}
+
+/* load_program of the live segment, which only shares it */
+static void run_loadp_share(Bench_state *state, uint64_t ops)
+{
+        uint32_t *registers = state->registers;
+        uint32_t program_counter;
+
+        registers[1] = state->live[0];
+        registers[2] = 0;
+        for (uint64_t op = 0; op < ops; op++) {
+                load_program(state->all_segments, registers, 1, 2,
+                             &program_counter);
+        }
+}
+
+/* load_program, then a store into segment 0, which copies it out */
+static void run_loadp_copy(Bench_state *state, uint64_t ops)
+{
+        uint32_t *registers = state->registers;
+        uint32_t program_counter;
+
+        for (uint64_t op = 0; op < ops; op++) {
+                registers[1] = state->live[0];
+                registers[2] = 0;
+                load_program(state->all_segments, registers, 1, 2,
+                             &program_counter);
+
+                registers[3] = 0;
+                registers[4] = op;
+                segmented_store(state->all_segments, registers, 3, 2, 4);
+        }
+}
+
+
+/* order ns/op figures, smallest first */
+static int compare_doubles(const void *a, const void *b)
+{
+        double value_a = *(const double *)a;
+        double value_b = *(const double *)b;
+        return (value_a > value_b) - (value_a < value_b);
+}
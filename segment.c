@@ -9,29 +9,147 @@
  *
  */
 
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
 #include "segment.h"
+#include "instructions.h"
+
+
+/* starting size of the segment table & of the unmapped ID stack */
+#define SEGMENTS_HINT 64
+
+/* 
+ * Segment allocator: small segments come from per-size-class free
+ * lists, refilled by carving up large slabs, so map/unmap churn never
+ * reaches malloc/free. Size classes step by POOL_GRANULE words (counting
+ * the reference count word), up to POOL_NUM_CLASSES * POOL_GRANULE
+ * words; anything bigger goes straight to calloc/free, & anything of
+ * POOL_MMAP_BYTES or more to its own anonymous mapping.
+ */
+#define POOL_GRANULE 4
+#define POOL_NUM_CLASSES 64
+#define POOL_SLAB_BYTES (64 * 1024)
+
+/* 
+ * Anonymous mappings come from the kernel as untouched zero pages, so a
+ * huge Map Segment costs nothing until the program writes to it, &
+ * munmap hands it straight back (free may keep it in malloc's heap).
+ * With huge pages on, mappings of HUGE_PAGE_BYTES or more are also
+ * offered to transparent huge pages.
+ */
+#define POOL_MMAP_BYTES (128 * 1024)
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)
+
+typedef struct Segment_pool {
+        /* head of each size class's free list, linked through the blocks */
+        void *free_lists[POOL_NUM_CLASSES];
+
+        /* unused tail of the newest slab */
+        uint8_t *bump;
+        size_t bump_left;
+
+        /* every slab, linked through its first word, freed at the end */
+        void *slabs;
+
+        Segment_pool_stats stats;
+} *Segment_pool;
+
+/* 
+ * Telemetry histograms have one bucket per power of 2: bucket 0 counts
+ * 0s, & bucket b counts values from 2^(b-1) to 2^b - 1
+ */
+#define TELEMETRY_BUCKETS 65
+
+typedef struct Segment_telemetry {
+        char *pathname;                 /* where the JSON goes */
+
+        /* clock when each ID was last mapped, indexed by ID */
+        uint64_t *mapped_at;
+        uint32_t mapped_at_capacity;
+
+        /* 
+         * Note: num_IDs never shrinks, so maps that took a fresh ID
+         *       are just the growth in num_IDs; the rest were recycled
+         */
+        uint64_t maps;
+        uint64_t unmaps;
+        uint32_t start_IDs;             /* num_IDs when telemetry began */
+        uint32_t peak_unmapped;         /* deepest the ID stack has been */
+
+        uint64_t live;                  /* segments mapped now (not 0) */
+        uint64_t peak_live;
+        uint64_t live_words;            /* ... & the words in them */
+        uint64_t peak_live_words;
+
+        uint64_t sizes[TELEMETRY_BUCKETS];      /* words, per map */
+        uint64_t lifetimes[TELEMETRY_BUCKETS];  /* instructions, per unmap */
+} Segment_telemetry;
+
+volatile sig_atomic_t segments_telemetry_wanted;
+
+
+static void reserve_ID(Segments all_segments);
+static uint32_t new_ID(Segments all_segments);
+
+static uint32_t *segment_new(Segments all_segments,
+                             uint32_t num_words,
+                             int zeroed);
+
+static void segment_release(Segments all_segments,
+                            uint32_t *segment,
+                            uint32_t num_words);
+
+static void telemetry_map(Segments all_segments, uint32_t seg_ID);
+
+static void telemetry_unmap(Segments all_segments, uint32_t seg_ID);
+
+static void telemetry_reserve(Segment_telemetry *telemetry,
+                              uint32_t num_IDs);
+
+static void write_buckets(FILE *fp, const char *name,
+                          const uint64_t *buckets);
+
+static unsigned bucket(uint64_t value);
+
+static void request_telemetry(int signum);
 
 
 /*      segments_initialize
- * Purpose: create Hanson sequences to hold mapped IDs, their segment's 
- *          respective lengths, & unmapped/recycled IDs
+ * Purpose: create the (empty) segment table & unmapped ID stack
  * Expectations: structures do not yet exist, we're at start of program
  * Input: N/A, none
- * Output: instance of Segments struct, containing 3 Hanson sequences
+ * Output: instance of Segments struct, with nothing mapped
  */
 Segments segments_initialize()
 {
         Segments all_segments = malloc(sizeof(*all_segments));
         assert(all_segments);
 
-        /* create Hanson sequence to hold the segments */
-        all_segments->mapped = Seq_new(0);
+        /* table of segments, grown by doubling as IDs are handed out */
+        all_segments->capacity = SEGMENTS_HINT;
+        all_segments->num_IDs = 0;
+        all_segments->mapped = malloc(sizeof(*all_segments->mapped) *
+                                      all_segments->capacity);
+        assert(all_segments->mapped != NULL);
+
+        /* stack of unmapped/recycled IDs */
+        all_segments->unmapped_capacity = SEGMENTS_HINT;
+        all_segments->num_unmapped = 0;
+        all_segments->unmapped = malloc(sizeof(*all_segments->unmapped) *
+                                        all_segments->unmapped_capacity);
+        assert(all_segments->unmapped != NULL);
+
+        all_segments->pool = calloc(1, sizeof(*all_segments->pool));
+        assert(all_segments->pool != NULL);
 
-        /* create Hanson sequence for unmapped/recycled IDs */
-        all_segments->unmapped = Seq_new(0);
+        all_segments->image = NULL;
+        all_segments->image_size = 0;
+        all_segments->hugepages = 0;
 
-        /* create Hanson sequence for lengths of segments */
-        all_segments->lengths = Seq_new(0);
+        all_segments->telemetry = NULL;
+        all_segments->now = 0;
 
         return all_segments;
 }
@@ -43,44 +161,54 @@ Segments segments_initialize()
  *          while taking advantage of any recycled IDs
  * Expectations: instance of Segments struct exists & is valid, 
  *               number of words > 0
- * Input: struct holding Hanson sequences to all segment items,
+ * Input: struct holding the segment table & unmapped IDs,
  *        uint32_t specifying number of words
- * Output: N/A, void - end result: new segment allocated, & its 
- *         ID is stored for later reference
+ * Output: ID of the new segment
  */
 uint32_t map_seg(Segments all_segments, uint32_t num_words)
 {
         assert(all_segments != NULL);
 
-        /* allocate space for new segment based on length */
-        uint32_t *segment = malloc(sizeof(num_words) * num_words);
-        assert(segment != NULL);
+        /* 
+         * allocate space for new segment based on length
+         * Note: room for the ID, then the words, before taking the ID,
+         *       so running out of memory leaves the table as it was
+         */
+        reserve_ID(all_segments);
+        uint32_t *words = segment_new(all_segments, num_words, 1);
+        uint32_t seg_ID = new_ID(all_segments);
+        Segment *entry = &all_segments->mapped[seg_ID];
+        entry->words = words;
+        entry->length = num_words;
 
-        uint32_t *seg_length = malloc(sizeof(num_words));
-        assert(seg_length != NULL);
-        *seg_length = num_words;
-        
-        /* if recycled ID exists, then use it, otherwise add to the end */
-        if (Seq_length(all_segments->unmapped) > 0) {
-                /* Seq_remlo returns pointer, so dereference for int ID */
-                uint32_t *open_address_p = Seq_remlo(all_segments->unmapped);
-                uint32_t open_address = *open_address_p;
-                free(open_address_p);
-                Seq_put(all_segments->mapped, open_address, segment);
-
-                uint32_t *old_length = Seq_put(all_segments->lengths,
-                                              open_address,
-                                              seg_length);
-                free(old_length);
-
-                return open_address;
-        } else {
-                /* recycled ID unavailable, so just create new ID */
-                Seq_addhi(all_segments->mapped, segment);
-                Seq_addhi(all_segments->lengths, seg_length);
-                return Seq_length(all_segments->mapped) - 1;
+        if (all_segments->telemetry != NULL) {
+                telemetry_map(all_segments, seg_ID);
         }
-        
+        return seg_ID;
+}
+
+/*      map_pinned_seg
+ * Purpose: map a segment onto words that belong to the caller, without
+ *          copying them
+ * Expectations: instance of Segments struct exists & is valid, words
+ *               are preceded by a SEG_REFS of SEG_PINNED & outlive
+ *               all_segments
+ * Input: struct holding the segment table & unmapped IDs, pointer to
+ *        the first word, uint32_t specifying number of words
+ * Output: ID of the new segment, whose first store copies it out
+ */
+uint32_t map_pinned_seg(Segments all_segments,
+                        uint32_t *words,
+                        uint32_t num_words)
+{
+        assert(all_segments != NULL);
+        assert(words != NULL && SEG_REFS(words) == SEG_PINNED);
+
+        uint32_t seg_ID = new_ID(all_segments);
+        all_segments->mapped[seg_ID].words = words;
+        all_segments->mapped[seg_ID].length = num_words;
+
+        return seg_ID;
 }
 
 
@@ -89,7 +217,7 @@ uint32_t map_seg(Segments all_segments, uint32_t num_words)
  *          an existing segment, & recycling its ID for later use
  * Expectations: instance of Segments struct exists & is valid, 
  *               segment ID < total number of allocated segments
- * Input: struct holding Hanson sequences to all segment items,
+ * Input: struct holding the segment table & unmapped IDs,
  *        uint32_t specifying ID of segment to recycle/unmap
  * Output: N/A, void - end result: existing segment deallocated, 
  *         & its ID is stored/recycled for later reuse
@@ -99,55 +227,594 @@ void unmap_seg(Segments all_segments, uint32_t seg_ID)
         assert(all_segments != NULL);
         assert(seg_ID > 0);
 
-        /* make segment memory available for another mapping */
-        uint32_t *segment = Seq_get(all_segments->mapped, seg_ID);
-        //uint32_t *length = Seq_get(all_segments->lengths, seg_ID);
-        free(segment);
-        //free(length);
-        
-        Seq_put(all_segments->mapped, seg_ID, NULL);
+        /* room to recycle the ID first, before anything changes */
+        if (all_segments->num_unmapped == all_segments->unmapped_capacity) {
+                uint32_t capacity = all_segments->unmapped_capacity * 2;
+                uint32_t *unmapped = realloc(all_segments->unmapped,
+                                             sizeof(*unmapped) * capacity);
+                GUEST_ASSERT(unmapped != NULL);
+                all_segments->unmapped = unmapped;
+                all_segments->unmapped_capacity = capacity;
+        }
+
+        if (all_segments->telemetry != NULL) {
+                telemetry_unmap(all_segments, seg_ID);
+        }
+
+        /* 
+         * make segment memory available for another mapping
+         * Note: if segment 0 still shares it, it lives on until that ends
+         */
+        Segment *entry = &all_segments->mapped[seg_ID];
+        segment_release(all_segments, entry->words, entry->length);
+        entry->words = NULL;
+        entry->length = 0;
 
         /* keep track of newly unmapped/recycled ID */
-        uint32_t *hold_ID = malloc(sizeof(seg_ID));
-        *hold_ID = seg_ID;
-        Seq_addhi(all_segments->unmapped, (void *)hold_ID);
+        all_segments->unmapped[all_segments->num_unmapped++] = seg_ID;
+}
+
+/*      share_seg
+ * Purpose: make dest_ID refer to the same words as src_ID, dropping
+ *          whatever dest_ID referred to before
+ * Expectations: instance of Segments struct exists & is valid, both
+ *               IDs are mapped
+ * Input: struct holding the segment table & unmapped IDs,
+ *        uint32_t ID to overwrite, uint32_t ID to share
+ * Output: N/A, void - end result: both IDs name one segment, which is
+ *         copied by unshare_seg before either side writes to it
+ */
+void share_seg(Segments all_segments, uint32_t dest_ID, uint32_t src_ID)
+{
+        assert(all_segments != NULL);
+
+        Segment *source = &all_segments->mapped[src_ID];
+        Segment *dest = &all_segments->mapped[dest_ID];
+        assert(source->words != NULL);
+
+        if (SEG_REFS(source->words) != SEG_PINNED) {
+                SEG_REFS(source->words)++;
+        }
+        segment_release(all_segments, dest->words, dest->length);
+        *dest = *source;
+}
+
+/*      unshare_seg
+ * Purpose: give seg_ID its own private copy of its words, so it can be
+ *          written without the change showing up under another ID
+ * Expectations: instance of Segments struct exists & is valid, seg_ID
+ *               is mapped & its words are shared (SEG_REFS > 1)
+ * Input: struct holding the segment table & unmapped IDs,
+ *        uint32_t ID of the segment about to be written
+ * Output: pointer to the segment's new, unshared words
+ */
+uint32_t *unshare_seg(Segments all_segments, uint32_t seg_ID)
+{
+        assert(all_segments != NULL);
+
+        Segment *entry = &all_segments->mapped[seg_ID];
+        uint32_t *shared = entry->words;
+
+        entry->words = segment_new(all_segments, entry->length, 0);
+        memcpy(entry->words, shared, sizeof(*shared) * entry->length);
+        segment_release(all_segments, shared, entry->length);
+
+        return entry->words;
+}
+
+/*      segments_install
+ * Purpose: replace the (empty) segment table & unmapped ID stack with
+ *          ones rebuilt elsewhere, e.g. from a snapshot image
+ * Expectations: nothing has been mapped yet, both arrays came from
+ *               malloc, every mapped segment's words are preceded by a
+ *               reference count (SEG_REFS)
+ * Input: struct holding the segment table & unmapped IDs, new table &
+ *        its number of IDs, new stack of unmapped IDs & its size, the
+ *        image the words live in (or NULL) & its size in bytes
+ * Output: N/A, void - end result: all_segments owns the arrays & image
+ */
+void segments_install(Segments all_segments,
+                      Segment *mapped, uint32_t num_IDs,
+                      uint32_t *unmapped, uint32_t num_unmapped,
+                      void *image, size_t image_size)
+{
+        assert(all_segments != NULL && all_segments->num_IDs == 0);
+        assert(mapped != NULL && unmapped != NULL);
+
+        free(all_segments->mapped);
+        free(all_segments->unmapped);
+
+        /* Note: never let either shrink below its hint, or doubling stalls */
+        all_segments->capacity = num_IDs > SEGMENTS_HINT ? num_IDs
+                                                         : SEGMENTS_HINT;
+        all_segments->mapped = realloc(mapped, sizeof(*mapped) *
+                                               all_segments->capacity);
+        all_segments->num_IDs = num_IDs;
+
+        all_segments->unmapped_capacity = num_unmapped > SEGMENTS_HINT ?
+                                          num_unmapped : SEGMENTS_HINT;
+        all_segments->unmapped = realloc(unmapped, sizeof(*unmapped) *
+                                         all_segments->unmapped_capacity);
+        all_segments->num_unmapped = num_unmapped;
+        assert(all_segments->mapped != NULL);
+        assert(all_segments->unmapped != NULL);
+
+        all_segments->image = image;
+        all_segments->image_size = image_size;
+}
+
+/*      segments_pool_stats
+ * Purpose: report how the segment allocator has been used so far
+ * Expectations: instance of Segments struct exists & is valid
+ * Input: struct holding the segment table & unmapped IDs
+ * Output: copy of the allocator's counters
+ */
+Segment_pool_stats segments_pool_stats(Segments all_segments)
+{
+        assert(all_segments != NULL);
+        return all_segments->pool->stats;
+}
+
+/*      segments_print_stats
+ * Purpose: write the segment allocator's counters, & the share of small
+ *          segments served from a free list (hit rate), to a stream
+ * Expectations: instance of Segments struct exists, fp is open
+ * Input: struct holding the segment table & unmapped IDs, output stream
+ * Output: N/A, void - end result: one line of counters written
+ */
+void segments_print_stats(Segments all_segments, FILE *fp)
+{
+        assert(all_segments != NULL);
+        assert(fp != NULL);
+
+        Segment_pool_stats stats = all_segments->pool->stats;
+        double hit_rate = stats.small_allocs == 0 ? 0.0 :
+                          100.0 * stats.recycled / stats.small_allocs;
+
+        fprintf(fp, "segment pool: %llu small (%.1f%% recycled), "
+                    "%llu large (%llu mmapped), %llu slabs\n",
+                (unsigned long long)stats.small_allocs, hit_rate,
+                (unsigned long long)stats.large_allocs,
+                (unsigned long long)stats.mmapped,
+                (unsigned long long)stats.slabs);
+}
+
+/*      segments_telemetry_start
+ * Purpose: start keeping telemetry on the segments the program maps,
+ *          & have SIGUSR1 ask for it to be written out
+ * Expectations: instance of Segments struct exists & is valid, & the
+ *               interpreter will keep its clock (all_segments->now)
+ * Input: struct holding the segment table & unmapped IDs, string
+ *        holding the filename to write the JSON to
+ * Output: N/A, void - end result: telemetry on, with segments already
+ *         mapped (other than 0) counted as live since instruction 0
+ */
+void segments_telemetry_start(Segments all_segments, char *pathname)
+{
+        assert(all_segments != NULL && pathname != NULL);
+        assert(all_segments->telemetry == NULL);
+
+        Segment_telemetry *telemetry = calloc(1, sizeof(*telemetry));
+        assert(telemetry != NULL);
+        telemetry->pathname = pathname;
+        telemetry_reserve(telemetry, all_segments->capacity);
+
+        /* e.g. those of a restored snapshot */
+        for (uint32_t seg_ID = 1; seg_ID < all_segments->num_IDs; seg_ID++) {
+                if (all_segments->mapped[seg_ID].words != NULL) {
+                        telemetry->live++;
+                        telemetry->live_words +=
+                                all_segments->mapped[seg_ID].length;
+                }
+        }
+        telemetry->peak_live = telemetry->live;
+        telemetry->peak_live_words = telemetry->live_words;
+        telemetry->peak_unmapped = all_segments->num_unmapped;
+        telemetry->start_IDs = all_segments->num_IDs;
+        all_segments->telemetry = telemetry;
+
+        /* Note: SA_RESTART, so the guest's I/O never sees EINTR */
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = request_telemetry;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        int installed = sigaction(SIGUSR1, &action, NULL);
+        assert(installed == 0);
+        (void)installed;
+}
+
+/*      segments_telemetry_write
+ * Purpose: write the telemetry so far as one JSON object, replacing
+ *          whatever was written last time
+ * Expectations: segments_telemetry_start was called
+ * Input: struct holding the segment table & unmapped IDs
+ * Output: N/A, void - end result: file written (through a temporary
+ *         file, renamed into place, so a reader never sees half of
+ *         one), & segments_telemetry_wanted cleared
+ * Note: ages of segments still mapped are given apart from lifetimes,
+ *       which are only of segments that have been unmapped
+ */
+void segments_telemetry_write(Segments all_segments)
+{
+        assert(all_segments != NULL && all_segments->telemetry != NULL);
+        Segment_telemetry *telemetry = all_segments->telemetry;
+        segments_telemetry_wanted = 0;
+
+        uint64_t ages[TELEMETRY_BUCKETS] = { 0 };
+        for (uint32_t seg_ID = 1; seg_ID < all_segments->num_IDs; seg_ID++) {
+                if (all_segments->mapped[seg_ID].words != NULL) {
+                        ages[bucket(all_segments->now -
+                                    telemetry->mapped_at[seg_ID])]++;
+                }
+        }
+
+        char temp_path[strlen(telemetry->pathname) + 32];
+        sprintf(temp_path, "%s.%ld.tmp", telemetry->pathname,
+                (long)getpid());
+        FILE *fp = fopen(temp_path, "w");
+        assert(fp != NULL);
+
+        uint64_t fresh_IDs = all_segments->num_IDs - telemetry->start_IDs;
+        uint64_t recycled_IDs = telemetry->maps - fresh_IDs;
+        double recycle_rate = telemetry->maps == 0 ? 0.0 :
+                              (double)recycled_IDs / telemetry->maps;
+        fprintf(fp, "{\"instructions\": %llu,\n",
+                (unsigned long long)all_segments->now);
+        fprintf(fp, " \"segments\": {\"maps\": %llu, \"unmaps\": %llu, "
+                    "\"live\": %llu, \"peak_live\": %llu},\n",
+                (unsigned long long)telemetry->maps,
+                (unsigned long long)telemetry->unmaps,
+                (unsigned long long)telemetry->live,
+                (unsigned long long)telemetry->peak_live);
+        fprintf(fp, " \"words\": {\"live\": %llu, \"peak_live\": %llu},\n",
+                (unsigned long long)telemetry->live_words,
+                (unsigned long long)telemetry->peak_live_words);
+        fprintf(fp, " \"ids\": {\"fresh\": %llu, \"recycled\": %llu, "
+                    "\"recycle_rate\": %.4f, \"unmapped\": %u, "
+                    "\"peak_unmapped\": %u},\n",
+                (unsigned long long)fresh_IDs,
+                (unsigned long long)recycled_IDs, recycle_rate,
+                all_segments->num_unmapped, telemetry->peak_unmapped);
+        write_buckets(fp, "sizes", telemetry->sizes);
+        fprintf(fp, ",\n");
+        write_buckets(fp, "lifetimes", telemetry->lifetimes);
+        fprintf(fp, ",\n");
+        write_buckets(fp, "live_ages", ages);
+        fprintf(fp, "}\n");
+
+        int closed = fclose(fp);
+        assert(closed == 0);
+        (void)closed;
+        int renamed = rename(temp_path, telemetry->pathname);
+        assert(renamed == 0);
+        (void)renamed;
 }
 
 /*      segments_free
  * Purpose: free all the memory that has been allocated by our
  *          universal machine
- * Expectations: instance of Segments struct exists & is valid, 
- *               number of words > 0
- * Input: struct holding Hanson sequences to all segment items
+ * Expectations: instance of Segments struct exists & is valid
+ * Input: struct holding the segment table & unmapped IDs
  * Output: N/A, void - end result: all segments emptied and freed
 */
 void segments_free(Segments all_segments)
 {
         assert(all_segments != NULL);
 
-        Seq_T mapped = all_segments->mapped;
-        Seq_T unmapped = all_segments->unmapped;
-        Seq_T lengths = all_segments->lengths;
+        /* Note: unmapped IDs have NULL words, which release ignores */
+        for (uint32_t seg_ID = 0; seg_ID < all_segments->num_IDs; seg_ID++) {
+                Segment *entry = &all_segments->mapped[seg_ID];
+                segment_release(all_segments, entry->words, entry->length);
+        }
 
-        /* free the elements of the 3 sequences */
-        while (Seq_length(mapped) > 0) {
-                uint32_t *word = (uint32_t *)Seq_remlo(mapped);
-                free(word);
+        /* small segments all live in slabs, so freeing those is enough */
+        void *slab = all_segments->pool->slabs;
+        while (slab != NULL) {
+                void *next = *(void **)slab;
+                free(slab);
+                slab = next;
         }
 
-        while (Seq_length(unmapped) > 0) {
-                uint32_t *word = (uint32_t *)Seq_remlo(unmapped);
-                free(word);
+        /* Note: anything still pointing into the image was just dropped */
+        if (all_segments->image != NULL) {
+                munmap(all_segments->image, all_segments->image_size);
         }
-        
-        while (Seq_length(lengths) > 0) {
-                uint32_t *length = (uint32_t *)Seq_remlo(lengths);
-                free(length);
+
+        if (all_segments->telemetry != NULL) {
+                free(all_segments->telemetry->mapped_at);
+                free(all_segments->telemetry);
         }
+        free(all_segments->pool);
+        free(all_segments->mapped);
+        free(all_segments->unmapped);
+        free(all_segments);
+}
 
-        Seq_free(&mapped);
-        Seq_free(&unmapped);
-        Seq_free(&lengths);
 
-        free(all_segments);
+/*      reserve_ID
+ * Purpose: make sure the segment table has room for whatever ID new_ID
+ *          picks next
+ * Expectations: instance of Segments struct exists & is valid
+ * Input: struct holding the segment table & unmapped IDs
+ * Output: N/A, void - end result: table grown if it had to be
+ * Note: out of memory is the guest's fault (see GUEST_ASSERT), & leaves
+ *       the table as it was
+ */
+static void reserve_ID(Segments all_segments)
+{
+        if (all_segments->num_unmapped > 0 ||
+            all_segments->num_IDs < all_segments->capacity) {
+                return;
+        }
+
+        uint32_t capacity = all_segments->capacity * 2;
+        Segment *mapped = realloc(all_segments->mapped,
+                                  sizeof(*mapped) * capacity);
+        GUEST_ASSERT(mapped != NULL);
+        all_segments->mapped = mapped;
+        all_segments->capacity = capacity;
+}
+
+/*      new_ID
+ * Purpose: pick the ID for a new segment: the most recently unmapped
+ *          one if there is one, otherwise the next unused ID
+ * Expectations: instance of Segments struct exists & is valid
+ * Input: struct holding the segment table & unmapped IDs
+ * Output: the ID, with room for it in the segment table
+ */
+static uint32_t new_ID(Segments all_segments)
+{
+        reserve_ID(all_segments);
+
+        /* if recycled ID exists, then use it, otherwise add to the end */
+        if (all_segments->num_unmapped > 0) {
+                return all_segments->unmapped[--all_segments->num_unmapped];
+        }
+        return all_segments->num_IDs++;
+}
+
+/*      segment_new
+ * Purpose: allocate the words for a segment, behind a reference count,
+ *          from its size class if it has one
+ * Expectations: instance of Segments struct exists & is valid
+ * Input: struct holding the segment table & unmapped IDs, uint32_t
+ *        specifying number of words, whether the words must be zeroed
+ *        (as the spec requires for Map Segment)
+ * Output: pointer to the first word, with SEG_REFS of 1
+ * Note: out of memory is the guest's fault (see GUEST_ASSERT), & leaves
+ *       the pool as it was
+ */
+static uint32_t *segment_new(Segments all_segments,
+                             uint32_t num_words,
+                             int zeroed)
+{
+        Segment_pool pool = all_segments->pool;
+        size_t block_words = (size_t)num_words + 1;
+        size_t size_class = (block_words - 1) / POOL_GRANULE;
+        uint32_t *block;
+
+        if (block_words * sizeof(*block) >= POOL_MMAP_BYTES) {
+                /* huge: fresh zero pages, only backed once touched */
+                size_t block_bytes = block_words * sizeof(*block);
+                block = mmap(NULL, block_bytes, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                GUEST_ASSERT(block != MAP_FAILED);
+#ifdef MADV_HUGEPAGE
+                if (all_segments->hugepages &&
+                    block_bytes >= HUGE_PAGE_BYTES) {
+                        /* Note: only a hint; THP may be off entirely */
+                        madvise(block, block_bytes, MADV_HUGEPAGE);
+                }
+#endif
+                pool->stats.large_allocs++;
+                pool->stats.mmapped++;
+        } else if (size_class >= POOL_NUM_CLASSES) {
+                /* too big to pool: calloc already hands back zeroes */
+                block = calloc(block_words, sizeof(*block));
+                GUEST_ASSERT(block != NULL);
+                pool->stats.large_allocs++;
+        } else {
+                size_t block_bytes = (size_class + 1) * POOL_GRANULE *
+                                     sizeof(*block);
+                pool->stats.small_allocs++;
+
+                if (pool->free_lists[size_class] != NULL) {
+                        /* reuse the most recently released block */
+                        block = pool->free_lists[size_class];
+                        pool->free_lists[size_class] = *(void **)block;
+                        pool->stats.recycled++;
+                        if (zeroed) {
+                                memset(block, 0, block_bytes);
+                        }
+                } else {
+                        if (pool->bump_left < block_bytes) {
+                                /* 
+                                 * start a new (zeroed) slab; its first
+                                 * granule links it into the slab list
+                                 */
+                                uint8_t *slab = calloc(1, POOL_SLAB_BYTES);
+                                GUEST_ASSERT(slab != NULL);
+                                *(void **)slab = pool->slabs;
+                                pool->slabs = slab;
+                                pool->stats.slabs++;
+
+                                size_t link = POOL_GRANULE * sizeof(*block);
+                                pool->bump = slab + link;
+                                pool->bump_left = POOL_SLAB_BYTES - link;
+                        }
+
+                        /* fresh slab memory has never been used */
+                        block = (uint32_t *)pool->bump;
+                        pool->bump += block_bytes;
+                        pool->bump_left -= block_bytes;
+                }
+        }
+
+        block[0] = 1;
+        return block + 1;
+}
+
+/*      segment_release
+ * Purpose: drop one reference to a segment's words, recycling them once
+ *          nothing refers to them
+ * Expectations: segment came from segment_new with this many words, or
+ *               is NULL
+ * Input: struct holding the segment table & unmapped IDs, pointer to
+ *        the first word of a segment (or NULL), its number of words
+ * Output: N/A, void - end result: reference count decremented, & the
+ *         words back on their free list (or freed, or unmapped) if it
+ *         reached 0; pinned words are left alone
+ */
+static void segment_release(Segments all_segments,
+                            uint32_t *segment,
+                            uint32_t num_words)
+{
+        if (segment == NULL || SEG_REFS(segment) == SEG_PINNED ||
+            --SEG_REFS(segment) > 0) {
+                return;
+        }
+
+        uint32_t *block = segment - 1;
+        size_t block_bytes = ((size_t)num_words + 1) * sizeof(*block);
+        size_t size_class = (size_t)num_words / POOL_GRANULE;
+
+        if (block_bytes >= POOL_MMAP_BYTES) {
+                munmap(block, block_bytes);
+        } else if (size_class >= POOL_NUM_CLASSES) {
+                free(block);
+        } else {
+                Segment_pool pool = all_segments->pool;
+                *(void **)block = pool->free_lists[size_class];
+                pool->free_lists[size_class] = block;
+        }
+}
+
+/*      telemetry_map
+ * Purpose: count a Map Segment in the telemetry
+ * Expectations: telemetry is on, seg_ID was just mapped
+ * Input: struct holding the segment table & unmapped IDs, the new ID
+ * Output: N/A, void - end result: counters, peaks & sizes updated
+ */
+static void telemetry_map(Segments all_segments, uint32_t seg_ID)
+{
+        Segment_telemetry *telemetry = all_segments->telemetry;
+        uint32_t num_words = all_segments->mapped[seg_ID].length;
+
+        telemetry_reserve(telemetry, all_segments->capacity);
+        telemetry->mapped_at[seg_ID] = all_segments->now;
+
+        telemetry->maps++;
+        telemetry->sizes[bucket(num_words)]++;
+
+        telemetry->live++;
+        telemetry->live_words += num_words;
+        if (telemetry->live > telemetry->peak_live) {
+                telemetry->peak_live = telemetry->live;
+        }
+        if (telemetry->live_words > telemetry->peak_live_words) {
+                telemetry->peak_live_words = telemetry->live_words;
+        }
+}
+
+/*      telemetry_unmap
+ * Purpose: count an Unmap Segment in the telemetry
+ * Expectations: telemetry is on, seg_ID is mapped & about to be
+ *               unmapped (& pushed on the unmapped ID stack)
+ * Input: struct holding the segment table & unmapped IDs, the ID
+ * Output: N/A, void - end result: counters, lifetimes & the stack's
+ *         peak updated
+ */
+static void telemetry_unmap(Segments all_segments, uint32_t seg_ID)
+{
+        Segment_telemetry *telemetry = all_segments->telemetry;
+
+        telemetry->unmaps++;
+        telemetry->lifetimes[bucket(all_segments->now -
+                                    telemetry->mapped_at[seg_ID])]++;
+        telemetry->live--;
+        telemetry->live_words -= all_segments->mapped[seg_ID].length;
+
+        if (all_segments->num_unmapped + 1 > telemetry->peak_unmapped) {
+                telemetry->peak_unmapped = all_segments->num_unmapped + 1;
+        }
+}
+
+/*      telemetry_reserve
+ * Purpose: make room in the telemetry for as many IDs as the segment
+ *          table has room for
+ * Expectations: telemetry exists
+ * Input: the telemetry, the segment table's capacity
+ * Output: N/A, void - end result: mapped_at covers every ID (new
+ *         entries are 0)
+ */
+static void telemetry_reserve(Segment_telemetry *telemetry,
+                              uint32_t num_IDs)
+{
+        if (num_IDs <= telemetry->mapped_at_capacity) {
+                return;
+        }
+
+        telemetry->mapped_at = realloc(telemetry->mapped_at,
+                                       sizeof(*telemetry->mapped_at) *
+                                       num_IDs);
+        assert(telemetry->mapped_at != NULL);
+        memset(telemetry->mapped_at + telemetry->mapped_at_capacity, 0,
+               sizeof(*telemetry->mapped_at) *
+               (num_IDs - telemetry->mapped_at_capacity));
+        telemetry->mapped_at_capacity = num_IDs;
+}
+
+/*      write_buckets
+ * Purpose: write one histogram as a JSON member: an array holding the
+ *          range & count of each bucket that isn't empty
+ * Expectations: fp is open, buckets has TELEMETRY_BUCKETS counts
+ * Input: stream, member name, the counts
+ * Output: N/A, void - end result: member written (no trailing comma)
+ */
+static void write_buckets(FILE *fp, const char *name,
+                          const uint64_t *buckets)
+{
+        fprintf(fp, " \"%s\": [", name);
+
+        int first = 1;
+        for (unsigned b = 0; b < TELEMETRY_BUCKETS; b++) {
+                if (buckets[b] == 0) {
+                        continue;
+                }
+                uint64_t min = b == 0 ? 0 : (uint64_t)1 << (b - 1);
+                uint64_t max = b == 0 ? 0 : min + (min - 1);
+                fprintf(fp, "%s\n  {\"min\": %llu, \"max\": %llu, "
+                            "\"count\": %llu}",
+                        first ? "" : ",", (unsigned long long)min,
+                        (unsigned long long)max,
+                        (unsigned long long)buckets[b]);
+                first = 0;
+        }
+        fprintf(fp, "%s]", first ? "" : "\n ");
+}
+
+/*      bucket
+ * Purpose: find the histogram bucket a value falls in
+ * Expectations: N/A
+ * Input: the value
+ * Output: 0 for 0, else 1 + the index of its highest set bit
+ */
+static unsigned bucket(uint64_t value)
+{
+        return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+/*      request_telemetry
+ * Purpose: SIGUSR1 handler: ask for the telemetry to be written out
+ * Expectations: segments_telemetry_start was called
+ * Input: signal number (unused)
+ * Output: N/A, void - end result: segments_telemetry_wanted set
+ * Note: writing it here wouldn't be async-signal-safe, so the machine
+ *       does it the next time it checks
+ */
+static void request_telemetry(int signum)
+{
+        (void)signum;
+        segments_telemetry_wanted = 1;
 }
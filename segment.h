@@ -14,30 +14,88 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <signal.h>
 
 #include "assert.h"
-#include "seq.h"
 
 
+/* one entry of the segment table: a segment's words & how many */
+typedef struct Segment {
+        uint32_t *words;
+        uint32_t length;
+} Segment;
+
 typedef struct Segments {
         /* 
-         * Hanson sequence of mapped IDs
+         * table of mapped segments, indexed by ID
          * Note: index == emulator's 32-bit address representation,
-         *       value at index == 64-bit (pointer) place in memory
-         *       holding the segments themselves, from our computers
+         *       entry == 64-bit (pointer) place in memory holding the
+         *       segment's words, plus its length; unmapped IDs have
+         *       NULL words
          */ 
-        Seq_T mapped; 
+        Segment *mapped;
+        uint32_t num_IDs;
+        uint32_t capacity;
+
+        /* 
+         * stack of unmapped IDs, most recently unmapped on top
+         * Note: reusing the newest ID first means its table entry is
+         *       likely still in cache
+         */
+        uint32_t *unmapped;
+        uint32_t num_unmapped;
+        uint32_t unmapped_capacity;
+
+        /* size-class allocator for segment words (see segment.c) */
+        struct Segment_pool *pool;
+
+        /* 
+         * snapshot image restored from (see snapshot.c), or NULL
+         * Note: restored segments' words live in the image & are pinned
+         *       (see SEG_PINNED)
+         */
+        void *image;
+        size_t image_size;
 
-        /* Hanson sequence of lengths of segments */
-        Seq_T lengths;
+        /* offer huge segments to transparent huge pages (--hugepages) */
+        int hugepages;
 
         /* 
-         * Hanson sequence of unmapped IDs 
-         * Note: value at given index in sequence == available ID
+         * telemetry on the program's segments (--segment-telemetry), or
+         * NULL, & the clock it reads: instructions run so far, which the
+         * interpreter sets before each Map & Unmap Segment while it's on
          */
-        Seq_T unmapped; 
+        struct Segment_telemetry *telemetry;
+        uint64_t now;
 } *Segments;
 
+/* counters kept by the segment allocator */
+typedef struct Segment_pool_stats {
+        uint64_t small_allocs;  /* segments that fit a size class */
+        uint64_t recycled;      /* ... of those, served from a free list */
+        uint64_t large_allocs;  /* segments too big for any size class */
+        uint64_t mmapped;       /* ... of those, given their own mapping */
+        uint64_t slabs;         /* slabs carved into size-class blocks */
+} Segment_pool_stats;
+
+
+/* 
+ * Each segment's words are preceded by a count of the IDs that refer to
+ * them, so Load Program can share a segment with segment 0 rather than
+ * copy it (copy on write)
+ * Note: only valid on a mapped segment's word pointer
+ */
+#define SEG_REFS(segment) ((segment)[-1])
+
+/* 
+ * A reference count that is never changed: the words belong to someone
+ * else (a snapshot image, or a program shared between threads), so they
+ * are never recycled, & are copied out on the first store to them.
+ * Since nothing writes the count, pinned words can be shared read-only
+ * by many Segments at once.
+ */
+#define SEG_PINNED UINT32_MAX
+
 
 Segments segments_initialize();
 
@@ -45,6 +103,56 @@ uint32_t map_seg(Segments all_segments, uint32_t num_words);
 
 void unmap_seg(Segments all_segments, uint32_t seg_ID);
 
+uint32_t map_pinned_seg(Segments all_segments,
+                        uint32_t *words,
+                        uint32_t num_words);
+
+void share_seg(Segments all_segments, uint32_t dest_ID, uint32_t src_ID);
+
+uint32_t *unshare_seg(Segments all_segments, uint32_t seg_ID);
+
+/* 
+ * Note: inline, since segment access is on the emulator's hot path;
+ *       the ID must be mapped
+ */
+static inline uint32_t *seg_words(Segments all_segments, uint32_t seg_ID)
+{
+        return all_segments->mapped[seg_ID].words;
+}
+
+static inline uint32_t seg_length(Segments all_segments, uint32_t seg_ID)
+{
+        return all_segments->mapped[seg_ID].length;
+}
+
+/* Note: any ID at all, for checking a guest's (see GUEST_CHECK) */
+static inline int seg_mapped(Segments all_segments, uint32_t seg_ID)
+{
+        return seg_ID < all_segments->num_IDs &&
+               all_segments->mapped[seg_ID].words != NULL;
+}
+
+void segments_install(Segments all_segments,
+                      Segment *mapped, uint32_t num_IDs,
+                      uint32_t *unmapped, uint32_t num_unmapped,
+                      void *image, size_t image_size);
+
+Segment_pool_stats segments_pool_stats(Segments all_segments);
+
+void segments_print_stats(Segments all_segments, FILE *fp);
+
+/* 
+ * Telemetry: histograms of sizes mapped & of lifetimes (in
+ * instructions), peak live segments & words, & how often IDs are
+ * recycled, written out as JSON; SIGUSR1 sets segments_telemetry_wanted,
+ * & whoever runs the machine writes it out when it next sees that
+ */
+extern volatile sig_atomic_t segments_telemetry_wanted;
+
+void segments_telemetry_start(Segments all_segments, char *pathname);
+
+void segments_telemetry_write(Segments all_segments);
+
 void segments_free(Segments all_segments);
 
 
@@ -0,0 +1,259 @@
+/*
+ *              ** snapshot.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Snapshot interface,
+ *             with all relevant functions and libraries
+ *
+ *             Image layout, all in host byte order:
+ *                 Snapshot_header
+ *                 uint32_t unmapped IDs, bottom of the stack first
+ *                 (padding to 8 bytes)
+ *                 Snapshot_entry for each ID
+ *                 for each distinct segment: its reference count word
+ *                 (always SEG_PINNED), then its words
+ *
+ *             The blocks are laid out exactly as segment_new lays them
+ *             out in memory, so a restore maps the file & points the
+ *             segment table straight at them: nothing is read or copied
+ *             until the program touches it.
+ *
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+
+
+#define NUM_REGISTERS 8
+
+/* first 8 bytes of every image (the last is the NUL) */
+#define SNAPSHOT_MAGIC "UMSNAP1"
+
+typedef struct Snapshot_header {
+        char magic[8];
+        uint32_t registers[NUM_REGISTERS];
+        uint32_t program_counter;
+        uint32_t num_IDs;
+        uint32_t num_unmapped;
+        uint32_t unused;        /* keeps the header a multiple of 8 */
+} Snapshot_header;
+
+/* where one ID's words are in the image */
+typedef struct Snapshot_entry {
+        uint64_t offset;        /* bytes to its first word, 0 if unmapped */
+        uint32_t length;
+        uint32_t unused;
+} Snapshot_entry;
+
+
+static size_t entries_offset(uint32_t num_unmapped);
+
+static void write_bytes(FILE *fp, const void *bytes, size_t size);
+
+
+/*      snapshot_write
+ * Purpose: save the machine's whole state to an image file, from which
+ *          snapshot_restore can resume it exactly
+ * Expectations: instance of Segments struct exists & is valid, file
+ *               can be created
+ * Input: image file to write, struct holding the segment table &
+ *        unmapped IDs, pointer to array of 8 registers, program counter
+ *        to resume at
+ * Output: N/A, void - end result: image written
+ * Note: only segment 0 is ever made to share another ID's words (by
+ *       Load Program), so a segment is shared exactly when its words
+ *       are segment 0's; those are written once
+ */
+void snapshot_write(char *pathname,
+                    Segments all_segments,
+                    uint32_t *registers,
+                    uint32_t program_counter)
+{
+        assert(pathname != NULL);
+        assert(all_segments != NULL && all_segments->num_IDs > 0);
+
+        Snapshot_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        memcpy(header.registers, registers, sizeof(header.registers));
+        header.program_counter = program_counter;
+        header.num_IDs = all_segments->num_IDs;
+        header.num_unmapped = all_segments->num_unmapped;
+
+        /* work out where each ID's words will go */
+        Snapshot_entry *entries = calloc(header.num_IDs, sizeof(*entries));
+        assert(entries != NULL);
+
+        uint64_t offset = entries_offset(header.num_unmapped) +
+                          sizeof(*entries) * header.num_IDs;
+        uint32_t *segment_zero = seg_words(all_segments, 0);
+
+        for (uint32_t seg_ID = 0; seg_ID < header.num_IDs; seg_ID++) {
+                uint32_t *words = seg_words(all_segments, seg_ID);
+                entries[seg_ID].length = seg_length(all_segments, seg_ID);
+
+                if (words == NULL) {
+                        continue;
+                } else if (seg_ID > 0 && words == segment_zero) {
+                        entries[seg_ID].offset = entries[0].offset;
+                } else {
+                        /* Note: the reference count word comes first */
+                        entries[seg_ID].offset = offset + sizeof(*words);
+                        offset += sizeof(*words) *
+                                  ((uint64_t)entries[seg_ID].length + 1);
+                }
+        }
+
+        FILE *fp = fopen(pathname, "wb");
+        assert(fp != NULL);
+
+        static const uint8_t padding[8] = { 0 };
+        size_t unmapped_bytes = sizeof(uint32_t) * header.num_unmapped;
+
+        write_bytes(fp, &header, sizeof(header));
+        write_bytes(fp, all_segments->unmapped, unmapped_bytes);
+        write_bytes(fp, padding, entries_offset(header.num_unmapped) -
+                                 sizeof(header) - unmapped_bytes);
+        write_bytes(fp, entries, sizeof(*entries) * header.num_IDs);
+
+        for (uint32_t seg_ID = 0; seg_ID < header.num_IDs; seg_ID++) {
+                uint32_t *words = seg_words(all_segments, seg_ID);
+                if (words == NULL || (seg_ID > 0 && words == segment_zero)) {
+                        continue;
+                }
+
+                /* 
+                 * restored segments belong to the image, so they are
+                 * pinned rather than counted
+                 */
+                uint32_t refs = SEG_PINNED;
+                write_bytes(fp, &refs, sizeof(refs));
+                write_bytes(fp, words, sizeof(*words) *
+                                       (size_t)entries[seg_ID].length);
+        }
+
+        int closed = fclose(fp);
+        assert(closed == 0);
+        (void)closed;
+        free(entries);
+}
+
+/*      snapshot_restore
+ * Purpose: resume a machine saved by snapshot_write, by mapping the
+ *          image & pointing a new segment table into it
+ * Expectations: file is an image written by snapshot_write on a host
+ *               of the same byte order
+ * Input: image file to read, pointer to array of 8 registers to fill,
+ *        pointer to the program counter to fill
+ * Output: instance of Segments struct holding every restored segment
+ * Note: the mapping is private, so nothing the program does reaches
+ *       the file
+ */
+Segments snapshot_restore(char *pathname,
+                          uint32_t *registers,
+                          uint32_t *program_counter)
+{
+        assert(pathname != NULL);
+        assert(registers != NULL && program_counter != NULL);
+
+        int fd = open(pathname, O_RDONLY);
+        assert(fd >= 0);
+
+        struct stat image_info;
+        int stat_result = fstat(fd, &image_info);
+        assert(stat_result == 0);
+        (void)stat_result;
+        size_t image_size = image_info.st_size;
+        assert(image_size >= sizeof(Snapshot_header));
+
+        uint8_t *image = mmap(NULL, image_size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE, fd, 0);
+        assert(image != MAP_FAILED);
+        close(fd);
+
+        Snapshot_header header;
+        memcpy(&header, image, sizeof(header));
+        assert(memcmp(header.magic, SNAPSHOT_MAGIC,
+                      sizeof(header.magic)) == 0);
+        assert(header.num_IDs > 0);
+
+        size_t entries_start = entries_offset(header.num_unmapped);
+        Snapshot_entry *entries = (Snapshot_entry *)(image + entries_start);
+        size_t blocks_start = entries_start +
+                              sizeof(*entries) * (size_t)header.num_IDs;
+        assert(blocks_start <= image_size);
+        (void)blocks_start;
+
+        /* the table & stack are ordinary arrays, as segments_initialize's */
+        Segment *mapped = malloc(sizeof(*mapped) * header.num_IDs);
+        uint32_t *unmapped = malloc(sizeof(*unmapped) *
+                                    (header.num_unmapped + 1));
+        assert(mapped != NULL && unmapped != NULL);
+
+        memcpy(unmapped, image + sizeof(header),
+               sizeof(*unmapped) * header.num_unmapped);
+        for (uint32_t i = 0; i < header.num_unmapped; i++) {
+                assert(unmapped[i] > 0 && unmapped[i] < header.num_IDs);
+        }
+
+        for (uint32_t seg_ID = 0; seg_ID < header.num_IDs; seg_ID++) {
+                Snapshot_entry *entry = &entries[seg_ID];
+                mapped[seg_ID].length = entry->length;
+
+                if (entry->offset == 0) {
+                        mapped[seg_ID].words = NULL;
+                        continue;
+                }
+
+                assert(entry->offset % sizeof(uint32_t) == 0);
+                assert(entry->offset >= blocks_start + sizeof(uint32_t));
+                assert(entry->offset + sizeof(uint32_t) *
+                       (uint64_t)entry->length <= image_size);
+                mapped[seg_ID].words = (uint32_t *)(image + entry->offset);
+        }
+        assert(mapped[0].words != NULL);
+
+        memcpy(registers, header.registers, sizeof(header.registers));
+        *program_counter = header.program_counter;
+
+        Segments all_segments = segments_initialize();
+        segments_install(all_segments, mapped, header.num_IDs,
+                         unmapped, header.num_unmapped, image, image_size);
+        return all_segments;
+}
+
+
+/*      entries_offset
+ * Purpose: find where the segment entries start in an image
+ * Expectations: N/A
+ * Input: number of unmapped IDs (which come before the entries)
+ * Output: byte offset of the first Snapshot_entry, a multiple of 8
+ */
+static size_t entries_offset(uint32_t num_unmapped)
+{
+        size_t end = sizeof(Snapshot_header) +
+                     sizeof(uint32_t) * (size_t)num_unmapped;
+        return (end + 7) & ~(size_t)7;
+}
+
+/*      write_bytes
+ * Purpose: write part of an image, failing loudly on a short write
+ * Expectations: fp is open for writing
+ * Input: stream, bytes to write, number of bytes
+ * Output: N/A, void - end result: bytes written
+ */
+static void write_bytes(FILE *fp, const void *bytes, size_t size)
+{
+        if (size > 0) {
+                size_t written = fwrite(bytes, 1, size, fp);
+                assert(written == size);
+                (void)written;
+        }
+}
@@ -0,0 +1,33 @@
+/*
+ *              ** snapshot.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Snapshot interface: saves the whole machine (registers,
+ *             program counter, & every segment) to an image file, &
+ *             resumes from one by mapping it straight into memory
+ *
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "segment.h"
+
+
+void snapshot_write(char *pathname,
+                    Segments all_segments,
+                    uint32_t *registers,
+                    uint32_t program_counter);
+
+Segments snapshot_restore(char *pathname,
+                          uint32_t *registers,
+                          uint32_t *program_counter);
+
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,147 @@
+#!/bin/sh
+#
+#               ** check.sh **
+#    Authors: Adrien Lynch & Silas Reed
+#                 jlynch07 & sreed05
+#       Date: Nov 22, 2022
+# Assignment: HW6
+#    Summary: make check: runs every tests/<name>.um (assembled from
+#             tests/<name>.uma) on tests/<name>.0, if there is one, in
+#             every way the machine can be run, & compares what it
+#             prints with tests/<name>.1
+#
+#             A program with a tests/<name>.fault must stop as a
+#             failure rather than halt (& print its .1 first, if it has
+#             one); any other must halt.
+#
+#             Usage: tests/check.sh (from the top directory, once built)
+#
+
+TESTS=tests
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/umcheck.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+failed=0
+checked=0
+
+# fail <what>: report a failed check
+fail() {
+        echo "FAIL: $1"
+        failed=$((failed + 1))
+}
+
+# expect <what> <expected> <got>: the two files must match
+expect() {
+        checked=$((checked + 1))
+        cmp -s "$2" "$3" || fail "$1: wrong output"
+}
+
+# verdict <what> <name> <status> <output>: how a run of a test ended
+# must be how the test says it ends
+verdict() {
+        checked=$((checked + 1))
+        if [ -f "$TESTS/$2.fault" ]; then
+                [ "$3" -ne 0 ] || fail "$2 ($1): halted"
+        elif [ "$3" -ne 0 ]; then
+                fail "$2 ($1): failed ($3)"
+        fi
+        if [ -f "$TESTS/$2.1" ]; then
+                expect "$2 ($1)" "$TESTS/$2.1" "$4"
+        fi
+}
+
+# input_of <name>: the test's input, or /dev/null
+input_of() {
+        if [ -f "$TESTS/$1.0" ]; then
+                echo "$TESTS/$1.0"
+        else
+                echo /dev/null
+        fi
+}
+
+for program in "$TESTS"/*.um; do
+        name=$(basename "$program" .um)
+        input=$(input_of "$name")
+        out="$WORK/$name"
+
+        ./um "$program" < "$input" > "$out.um" 2>/dev/null
+        verdict um "$name" $? "$out.um"
+
+        ./um --jit "$program" < "$input" > "$out.jit" 2>/dev/null
+        verdict "um --jit" "$name" $? "$out.jit"
+
+        ./um --cache "$WORK/cache" "$program" < "$input" > "$out.cold" \
+                2>/dev/null
+        verdict "um --cache, cold" "$name" $? "$out.cold"
+        ./um --cache "$WORK/cache" "$program" < "$input" > "$out.warm" \
+                2>/dev/null
+        verdict "um --cache, warm" "$name" $? "$out.warm"
+
+        ./tests/libhost "$program" 1000 "$input" > "$out.lib"
+        status=$?
+        [ $status -eq 2 ] && fail "$name (libum): slice over budget"
+        verdict "libum, 1000 at a time" "$name" $status "$out.lib"
+
+        ./"${program%.um}.native" < "$input" > "$out.native" 2>/dev/null
+        verdict "um2c" "$name" $? "$out.native"
+
+        [ -f "$TESTS/$name.fault" ] && continue
+
+        ./um --record "$out.log" "$program" < "$input" > "$out.rec"
+        verdict "um --record" "$name" $? "$out.rec"
+        ./um --replay "$out.log" "$program" < /dev/null > "$out.rep"
+        verdict "um --replay" "$name" $? "$out.rep"
+
+        # a restored run prints what followed the first Input
+        ./um --snapshot-at-input "$out.img" "$program" < "$input" \
+                > "$out.snap"
+        verdict "um --snapshot-at-input" "$name" $? "$out.snap"
+        if [ -f "$out.img" ]; then
+                size=$(./um --restore "$out.img" < "$input" |
+                       tee "$out.post" | wc -c)
+                tail -c "$size" "$TESTS/$name.1" > "$out.tail"
+                expect "$name (um --restore)" "$out.tail" "$out.post"
+                ./um --jit --restore "$out.img" < "$input" > "$out.postj"
+                expect "$name (um --jit --restore)" "$out.tail" \
+                       "$out.postj"
+        fi
+done
+
+# um-batch: every test twice, the ones that halt with their output kept,
+# so the ones that fault fail amid jobs that must not, & lanes.um on
+# each byte that makes it fault, in the middle of a lockstep group
+: > "$WORK/manifest"
+for round in 1 2; do
+        for program in "$TESTS"/*.um; do
+                name=$(basename "$program" .um)
+                output="$WORK/$name.$round"
+                [ -f "$TESTS/$name.fault" ] && output=-
+                echo "$program $(input_of "$name") $output" \
+                        >> "$WORK/manifest"
+        done
+done
+for byte in 0 1 2 3; do
+        printf "\\$byte" > "$WORK/lane$byte"
+        echo "$TESTS/lanes.um $WORK/lane$byte -" >> "$WORK/manifest"
+done
+
+jobs=$(wc -l < "$WORK/manifest")
+faults=$(grep -c -- " -\$" "$WORK/manifest")
+for options in "" "--threads 3" "--lockstep 4"; do
+        ./um-batch $options "$WORK/manifest" 2> "$WORK/batch.err"
+        checked=$((checked + 1))
+        grep -q "$jobs jobs, $faults failed" "$WORK/batch.err" ||
+                fail "um-batch $options: not $faults of $jobs jobs failed"
+        for round in 1 2; do
+                for expected in "$TESTS"/*.1; do
+                        name=$(basename "$expected" .1)
+                        [ -f "$TESTS/$name.fault" ] && continue
+                        expect "$name (um-batch $options)" "$expected" \
+                               "$WORK/$name.$round"
+                        rm -f "$WORK/$name.$round"
+                done
+        done
+done
+
+echo "$checked checks, $failed failed"
+[ "$failed" -eq 0 ]
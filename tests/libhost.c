@@ -0,0 +1,170 @@
+/*
+ *              ** libhost.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Test host for libum: runs one program in slices of at
+ *             most <budget> instructions, handing it input a byte at a
+ *             time with a UM_INPUT_AGAIN before each byte, & writes its
+ *             output to stdout (for make check)
+ *
+ *             Usage: tests/libhost <program.um> <budget> [<input>]
+ *
+ *             Exits 0 if the program halted, 1 if it faulted, & 2 if a
+ *             slice ran over its budget, or anything else went wrong.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "assert.h"
+#include "libum.h"
+
+
+typedef struct Host_input {
+        uint8_t *bytes;
+        size_t size;
+        size_t next;
+        int waited;             /* UM_INPUT_AGAIN given for the next byte */
+} Host_input;
+
+
+static uint8_t *read_file(const char *path, size_t *size);
+
+static long host_input(void *context, uint8_t *bytes, size_t size);
+
+static void host_output(void *context, const uint8_t *bytes, size_t size);
+
+
+/*      main
+ * Purpose: run the program to the end, slice by slice, checking that
+ *          no slice runs more instructions than it was given
+ * Expectations: program (& input, if given) can be read
+ * Input: number of command line arguments, content of arguments
+ * Output: 0 on UM_HALTED, 1 on UM_FAULT, 2 on a slice over budget or
+ *         bad usage
+ */
+int main(int argc, char *argv[])
+{
+        if (argc != 3 && argc != 4) {
+                fprintf(stderr, "Usage: tests/libhost <program.um> "
+                                "<budget> [<input>]\n");
+                return 2;
+        }
+        uint64_t budget = strtoull(argv[2], NULL, 10);
+
+        size_t size;
+        uint8_t *image = read_file(argv[1], &size);
+        Host_input input = { NULL, 0, 0, 0 };
+        if (argc == 4) {
+                input.bytes = read_file(argv[3], &input.size);
+        }
+        if (image == NULL || (argc == 4 && input.bytes == NULL) ||
+            budget == 0) {
+                fprintf(stderr, "libhost: bad program, input or budget\n");
+                return 2;
+        }
+
+        Um_callbacks callbacks = { host_input, host_output, &input };
+        Um_vm vm = um_create(image, size, callbacks);
+        free(image);
+
+        Um_status status;
+        uint64_t before = 0;
+        int over_budget = 0;
+        do {
+                status = um_run(vm, budget);
+                uint64_t after = um_instructions(vm);
+                if (after - before > budget) {
+                        fprintf(stderr, "libhost: slice ran %llu "
+                                        "instructions of %llu\n",
+                                (unsigned long long)(after - before),
+                                (unsigned long long)budget);
+                        over_budget = 1;
+                }
+                before = after;
+        } while (status == UM_BUDGET_EXHAUSTED || status == UM_NEEDS_INPUT);
+
+        um_destroy(vm);
+        free(input.bytes);
+        fflush(stdout);
+
+        if (over_budget) {
+                return 2;
+        }
+        return status == UM_HALTED ? 0 : 1;
+}
+
+/*      read_file
+ * Purpose: read a whole file into memory
+ * Expectations: N/A
+ * Input: path to the file, where to put its size
+ * Output: malloc'd bytes of the file (at least one, so never NULL when
+ *         empty), or NULL if it can't be read
+ */
+static uint8_t *read_file(const char *path, size_t *size)
+{
+        assert(path != NULL && size != NULL);
+
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                return NULL;
+        }
+
+        size_t capacity = 4096;
+        uint8_t *bytes = malloc(capacity);
+        assert(bytes != NULL);
+        *size = 0;
+
+        size_t got;
+        while ((got = fread(bytes + *size, 1, capacity - *size, fp)) > 0) {
+                *size += got;
+                if (*size == capacity) {
+                        capacity *= 2;
+                        bytes = realloc(bytes, capacity);
+                        assert(bytes != NULL);
+                }
+        }
+        fclose(fp);
+        return bytes;
+}
+
+/*      host_input
+ * Purpose: input callback: every byte is first refused once, so the
+ *          machine has to come back for it (UM_NEEDS_INPUT)
+ * Expectations: context is the Host_input
+ * Input: the Host_input, where to put the bytes, how many fit
+ * Output: 1 byte, UM_INPUT_AGAIN, or 0 once all input has been given
+ */
+static long host_input(void *context, uint8_t *bytes, size_t size)
+{
+        Host_input *input = context;
+        assert(input != NULL && bytes != NULL && size > 0);
+        (void)size;
+
+        if (input->next == input->size) {
+                return 0;
+        }
+        if (!input->waited) {
+                input->waited = 1;
+                return UM_INPUT_AGAIN;
+        }
+        input->waited = 0;
+        bytes[0] = input->bytes[input->next++];
+        return 1;
+}
+
+/*      host_output
+ * Purpose: output callback: pass the program's output on to stdout
+ * Expectations: N/A
+ * Input: unused context, the bytes, how many
+ * Output: N/A, void - end result: bytes written to stdout
+ */
+static void host_output(void *context, const uint8_t *bytes, size_t size)
+{
+        (void)context;
+        fwrite(bytes, 1, size, stdout);
+}
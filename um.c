@@ -11,206 +11,243 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/stat.h>
+#include <string.h>
+#include <unistd.h>
 #include <assert.h>
-#include "seq.h"
 
 #include "segment.h"
-#include "instructions.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "loader.h"
+#include "snapshot.h"
+#include "cache.h"
+#include "sampler.h"
+#include "iolog.h"
+#include "profile.h"
 
 
 #define NUM_REGISTERS 8
 
-typedef enum Um_opcode {
-        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
-        NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV
-} Um_opcode;
+/* command line options, each given as --name before the .um file */
+typedef struct Um_options {
+        int jit;                /* --jit: run translated code */
+        int pool_stats;         /* --pool-stats: allocator counters */
+        int interactive;        /* --interactive: flush output per line */
+        uint64_t flush_ms;      /* --flush-interval <ms>: timed flushes */
+        int fusion_stats;       /* --fusion-stats: fused share of code */
+        int hugepages;          /* --hugepages: THP for huge segments */
+        int async_io;           /* --async-io: I/O on threads of its own */
+        char *snapshot;         /* --snapshot-at-input <file> */
+        char *restore;          /* --restore <file>, in place of program */
+        char *cache;            /* --cache <dir>: preprocessed programs */
+        char *sample_profile;   /* --sample-profile <file>: flame graph */
+        char *record;           /* --record <log>: save all input */
+        char *replay;           /* --replay <log>: input from a record */
+        char *telemetry;        /* --segment-telemetry <file>: JSON */
+        char *program;
+} Um_options;
 
 
-uint32_t *read_file(char *pathname, Segments all_segments);
+Um_options parse_options(int argc, char *argv[]);
 
-uint32_t fetch(uint32_t *seg0, uint32_t *program_counter);
-
-void decode(uint32_t instruction, 
-            Um_opcode *opcode, 
-            uint32_t *ra, uint32_t *rb, uint32_t *rc, 
-            uint32_t *val);
+void finish(Segments all_segments, Um_io io, Um_options *options);
 
 
 /*      main
  * Purpose: drive the program by initializing structures, preparing
- *          the passed file, & running the instruction loop
+ *          the passed file, & running it (interpreted or translated)
  * Expectations: arguments have been specified appropriately
  * Input: number of command line arguments, content of arguments 
  * Output: 0, to signal program completed & exited successfully
  */
 int main(int argc, char *argv[])
 {
-        /* confirm .um program provided */
-        if (argc != 2) {
-                fprintf(stderr, "Usage: ./um <input_file>\n");
-                exit(EXIT_FAILURE);
-        }
+        /* confirm .um program provided, after any options */
+        Um_options options = parse_options(argc, argv);
         
         /* initialize starting state */
         uint32_t registers[NUM_REGISTERS] = { 0 };
         uint32_t program_counter = 0;
 
-        Segments all_segments = segments_initialize();
-        uint32_t *segment_zero = read_file(argv[1], all_segments);
-
-        /* variables for fetch, decode, execute loop */
-        uint32_t next_instruction;
-        Um_opcode opcode = 0;
-        uint32_t ra, rb, rc, val;
-
-        /* check for HALT command before entering loop */
-        while (opcode != HALT) { 
-                next_instruction = fetch(segment_zero, &program_counter);
-
-                decode(next_instruction, &opcode, &ra, &rb, &rc, &val);
-
-                /* 
-                 * with instructions fetched & decoded,
-                 * EXECUTE: 
-                 */
-                if (opcode == CMOV) {
-                        conditional_move(registers, ra, rb, rc);
-                } else if (opcode == SLOAD) {
-                        segmented_load(all_segments, registers, ra, rb, rc);
-                } else if (opcode == SSTORE) {
-                        segmented_store(all_segments, registers, ra, rb, rc);
-                } else if (opcode == ADD) {
-                        addition(registers, ra, rb, rc);
-                } else if (opcode == MUL) {
-                        multiplication(registers, ra, rb, rc);
-                } else if (opcode == DIV){
-                        division(registers, ra, rb, rc);
-                } else if (opcode == NAND) {
-                        bitwise_NAND(registers, ra, rb, rc);
-                } else if (opcode == ACTIVATE) { /* map_segment */
-                        map_segment(all_segments, registers, rb, rc);
-                } else if (opcode == INACTIVATE) { /* unmap_segment */
-                        unmap_segment(all_segments, registers, rc);
-                } else if (opcode == OUT) {
-                        output(registers, rc);
-                } else if (opcode == IN) {
-                        input(registers, rc);
-                } else if (opcode == LOADP) {
-                        load_program(all_segments, 
-                                     registers, 
-                                     rb, rc, 
-                                     &program_counter);
-                } else if (opcode == LV) {
-                        load_value(registers, ra, val);
-                }
-                /* update segment zero to be correct */
-                segment_zero = Seq_get(all_segments->mapped, 0);
+        /* 
+         * start from the .um file (or its cache entry, which already has
+         * segment 0 predecoded), or resume a saved machine
+         */
+        Segments all_segments = NULL;
+        void *predecoded = NULL;
+        if (options.restore != NULL) {
+                all_segments = snapshot_restore(options.restore, registers,
+                                                &program_counter);
+        } else if (options.cache != NULL) {
+                all_segments = cache_load(options.cache, options.program,
+                                          &predecoded);
+        }
+        if (all_segments == NULL) {
+                all_segments = segments_initialize();
+                read_file(options.program, all_segments);
+        }
+        all_segments->hugepages = options.hugepages;
+
+        /* Note: a replay never reads stdin, so it can't wait on a terminal */
+        Um_io io = umio_new(options.replay != NULL ? -1 : STDIN_FILENO,
+                            STDOUT_FILENO,
+                            options.interactive, options.flush_ms,
+                            options.async_io);
+
+        /* the JIT runs the whole program itself, in translated code */
+        if (options.jit) {
+                int status = jit_execute(all_segments, io, registers,
+                                         program_counter);
+                finish(all_segments, io, &options);
+                return status;
         }
 
-        /* clean memory & return */
-        segments_free(all_segments);
-        return EXIT_SUCCESS;
+        /* otherwise the predecoding interpreter runs it */
+        Iolog io_log = NULL;
+        if (options.record != NULL) {
+                io_log = iolog_record(options.record);
+        } else if (options.replay != NULL) {
+                io_log = iolog_replay(options.replay);
+        }
+        if (options.telemetry != NULL) {
+                segments_telemetry_start(all_segments, options.telemetry);
+        }
+        if (options.sample_profile != NULL) {
+                sampler_start();
+        }
+        Interpreter_options run_options = { options.snapshot,
+                                            options.fusion_stats,
+                                            predecoded, NULL, io_log };
+        int status = interpret(all_segments, io, registers,
+                               program_counter, &run_options);
+        if (io_log != NULL) {
+                iolog_close(io_log, stderr);
+        }
+        finish(all_segments, io, &options);
+        return status;
 }
 
 
-/*      read_file
- * Purpose: use stat tool to get details of .um file, then set up
- *          program by instantiating segment 0
- * Expectations: provided file is valid (.um), instance of Segments
- *               struct exists & is valid
- * Input: string holding filename specified on command line, 
- *        struct holding Hanson sequences to all segment items
- * Output: uint32_t holding segment 0 (the full program)
-*/
-uint32_t *read_file(char *pathname, Segments all_segments)
+/*      parse_options
+ * Purpose: read any --options, then the name of the .um program
+ * Expectations: N/A
+ * Input: number of command line arguments, content of arguments
+ * Output: Um_options filled in from the command line; prints usage &
+ *         exits on anything unrecognized
+ */
+Um_options parse_options(int argc, char *argv[])
 {
-        assert(pathname != NULL);
-        assert(all_segments != NULL);
-        
-        /* 
-         * confirm scan of provided program successful, then get info 
-         * Note: size of file divided by 4 since 32-bit word == 4 bytes,
-         * so this gives us total number of 32-bit words
-         */
-        struct stat program_info;
-        assert(stat(pathname, &program_info) == 0); 
-
-        /* Note: will only read up to the last complete word in file */
-        const int total_words = program_info.st_size / 4;
-
-        map_seg(all_segments, total_words);
-
-        FILE *fp = fopen(pathname, "r");
-        assert(fp != NULL);
-
-        /* write each word in segment one byte at a time (big endian order) */
-        uint32_t *segment_zero = (uint32_t *)Seq_get(all_segments->mapped, 0);
-        
-        for (int word = 0; word < total_words; word++) {
-                for (int lsb = 24; lsb >= 0; lsb -= 8) {
-                        uint32_t piece = getc(fp);
-                        segment_zero[word] = Bitpack_newu(segment_zero[word], 
-                                                          8,
-                                                          lsb,
-                                                          piece);
+        Um_options options = { 0 };
+
+        int arg = 1;
+        for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+                if (strcmp(argv[arg], "--jit") == 0) {
+                        options.jit = 1;
+                } else if (strcmp(argv[arg], "--pool-stats") == 0) {
+                        options.pool_stats = 1;
+                } else if (strcmp(argv[arg], "--fusion-stats") == 0) {
+                        options.fusion_stats = 1;
+                } else if (strcmp(argv[arg], "--hugepages") == 0) {
+                        options.hugepages = 1;
+                } else if (strcmp(argv[arg], "--async-io") == 0) {
+                        options.async_io = 1;
+                } else if (strcmp(argv[arg], "--interactive") == 0) {
+                        options.interactive = 1;
+                } else if (strcmp(argv[arg], "--flush-interval") == 0 &&
+                           arg + 1 < argc) {
+                        options.flush_ms = strtoull(argv[++arg], NULL, 10);
+                } else if (strcmp(argv[arg], "--snapshot-at-input") == 0 &&
+                           arg + 1 < argc) {
+                        options.snapshot = argv[++arg];
+                } else if (strcmp(argv[arg], "--restore") == 0 &&
+                           arg + 1 < argc) {
+                        options.restore = argv[++arg];
+                } else if (strcmp(argv[arg], "--cache") == 0 &&
+                           arg + 1 < argc) {
+                        options.cache = argv[++arg];
+                } else if (strcmp(argv[arg], "--sample-profile") == 0 &&
+                           arg + 1 < argc) {
+                        options.sample_profile = argv[++arg];
+                } else if (strcmp(argv[arg], "--record") == 0 &&
+                           arg + 1 < argc) {
+                        options.record = argv[++arg];
+                } else if (strcmp(argv[arg], "--replay") == 0 &&
+                           arg + 1 < argc) {
+                        options.replay = argv[++arg];
+                } else if (strcmp(argv[arg], "--segment-telemetry") == 0 &&
+                           arg + 1 < argc) {
+                        options.telemetry = argv[++arg];
+                } else {
+                        break;
                 }
         }
 
-        fclose(fp);
-        return segment_zero;
-}
-
-
-/*      fetch
- * Purpose: get the word within segment 0 specified by program 
- *          counter, & return it
- * Expectations: segment 0 exists & holds the valid contents of
- *               the full program, program counter >= 0, & also
- *               program counter < total number of words
- * Input: pointer to segment 0, pointer to program counter
- * Output: current word to be unpacked & executed (type uint32_t)
-*/
-uint32_t fetch(uint32_t *seg0, uint32_t *program_counter)
-{
-        assert(seg0 != NULL);
-        assert(program_counter != NULL);
+        /* 
+         * a restored machine already has its program, & translated code
+         * keeps the registers (& program counter) where the snapshot,
+         * the sampler, the I/O log, & segment telemetry can't see them
+         */
+        int num_programs = options.restore != NULL ? 0 : 1;
+        int io_logs = (options.record != NULL) + (options.replay != NULL);
+        if (arg != argc - num_programs ||
+            (arg < argc && strncmp(argv[arg], "--", 2) == 0) ||
+            io_logs > 1 ||
+            (options.jit && (options.snapshot != NULL ||
+                             options.sample_profile != NULL ||
+                             options.telemetry != NULL || io_logs > 0))) {
+                fprintf(stderr, "Usage: ./um [--jit] [--pool-stats] "
+                                "[--fusion-stats] [--hugepages] "
+                                "[--async-io] [--interactive] "
+                                "[--flush-interval <ms>] "
+                                "[--snapshot-at-input <file>] "
+                                "[--cache <dir>] "
+                                "[--sample-profile <file>] "
+                                "[--record <log> | --replay <log>] "
+                                "[--segment-telemetry <file>] "
+                                "(<input_file> | --restore <file>)\n"
+                                "       (--snapshot-at-input, "
+                                "--sample-profile, --record, --replay, & "
+                                "--segment-telemetry do not work with "
+                                "--jit)\n");
+                exit(EXIT_FAILURE);
+        }
 
-        /* identify our next word in segment */
-        uint32_t curr_word = seg0[*program_counter];
-        (*program_counter)++;
-        return curr_word;
+        options.program = num_programs == 1 ? argv[arg] : NULL;
+        return options;
 }
 
-/*      decode
- * Purpose: break down a um instruction into its parts cosisting
- *          of opcodes, register(s) and possibly a value
- * Expectations: all the pointers (opcode, registers, value) exist
- * Input: uint32_t representing the um instruction, pointers to the
- *        variables to hold the opcode, registers, and value
- * Output: N/A, void - end result: opcode, at least one register,
- *         and possibly the value are updated
+/*      finish
+ * Purpose: flush guest output, report anything requested by the
+ *          options (& the profile, in um-prof), then free everything,
+ *          once the program has stopped
+ * Expectations: instance of Segments struct exists & is valid
+ * Input: struct holding the segment table & unmapped IDs, guest I/O,
+ *        options
+ * Output: N/A, void - end result: output written & all segments freed
  */
-void decode(uint32_t instruction, 
-            Um_opcode *opcode, 
-            uint32_t *ra, uint32_t *rb, uint32_t *rc, 
-            uint32_t *val)
+void finish(Segments all_segments, Um_io io, Um_options *options)
 {
-        assert(opcode != NULL);
-        assert(ra != NULL);
-        assert(rb != NULL);
-        assert(rc != NULL);
-        assert(val != NULL);
-
-        /* get opcode and register/value info based on instruction type */
-        *opcode = Bitpack_getu(instruction, 4, 28);
-
-        if (*opcode == LV) {
-                *ra  = Bitpack_getu(instruction, 3, 25);
-                *val = Bitpack_getu(instruction, 25, 0);
-        } else {
-                *ra = Bitpack_getu(instruction, 3, 6);
-                *rb = Bitpack_getu(instruction, 3, 3);
-                *rc = Bitpack_getu(instruction, 3, 0);
+        umio_free(io);
+
+        /* Note: after the last flush, so that's sampled too */
+        if (options->sample_profile != NULL) {
+                sampler_stop();
+                FILE *fp = fopen(options->sample_profile, "w");
+                assert(fp != NULL);
+                sampler_report(fp, stderr);
+                int closed = fclose(fp);
+                assert(closed == 0);
+                (void)closed;
+        }
+
+#ifdef UM_PROFILE
+        profile_report(all_segments, options->jit, stderr);
+#endif
+        if (options->pool_stats) {
+                segments_print_stats(all_segments, stderr);
+        }
+        if (options->telemetry != NULL) {
+                segments_telemetry_write(all_segments);
         }
-}
\ No newline at end of file
+        segments_free(all_segments);
+}
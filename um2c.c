@@ -0,0 +1,229 @@
+/*
+ *              ** um2c.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Ahead-of-time translator: turns a .um program into C that
+ *             runs it natively, for compiling against the Native runtime
+ *             (native.h) & the machine's own objects
+ *
+ *             Usage: ./um2c <program.um> [output.c]
+ *
+ *             Every word gets a label & straight-line C; Load Program of
+ *             segment 0 jumps through a switch over all the labels (or
+ *             straight to its target, when the word before it loads the
+ *             target as a constant). A store into segment 0, a Load
+ *             Program of another segment, an invalid opcode, or running
+ *             off the end hands the machine to the interpreter, which
+ *             finishes the run.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "instructions.h"
+#include "loader.h"
+
+
+/* words per line of the emitted image */
+#define IMAGE_WORDS_PER_LINE 6
+
+static void emit_image(FILE *out, uint32_t *words, uint32_t num_words);
+
+static void emit_word(FILE *out, uint32_t *words, uint32_t num_words,
+                      uint32_t index);
+
+
+/*      main
+ * Purpose: translate the program & write the C
+ * Expectations: program is a valid .um file
+ * Input: number of command line arguments, content of arguments
+ * Output: EXIT_SUCCESS once the C has been written
+ */
+int main(int argc, char *argv[])
+{
+        if (argc != 2 && argc != 3) {
+                fprintf(stderr, "Usage: ./um2c <program.um> [output.c]\n");
+                exit(EXIT_FAILURE);
+        }
+
+        uint32_t num_words;
+        uint32_t *words = read_pinned_file(argv[1], &num_words);
+
+        FILE *out = argc == 3 ? fopen(argv[2], "w") : stdout;
+        if (out == NULL) {
+                fprintf(stderr, "um2c: cannot create %s\n", argv[2]);
+                exit(EXIT_FAILURE);
+        }
+
+        fprintf(out, "/*\n * Translated from %s by um2c; do not edit.\n"
+                     " */\n\n", argv[1]);
+        fprintf(out, "#include \"native.h\"\n\n\n");
+        emit_image(out, words, num_words);
+
+        /*
+         * the program: registers are locals, so the compiler can keep
+         * them in machine registers; every run starts at the switch
+         */
+        fprintf(out, "static int run(Segments all_segments, Um_io io)\n{\n");
+        fprintf(out, "        uint32_t r0 = 0, r1 = 0, r2 = 0, r3 = 0;\n");
+        fprintf(out, "        uint32_t r4 = 0, r5 = 0, r6 = 0, r7 = 0;\n");
+        fprintf(out, "        uint32_t pc = 0;\n\n");
+
+        /* Note: the label is only emitted if some LOADP will use it */
+        int has_loadp = 0;
+        for (uint32_t index = 0; index < num_words; index++) {
+                has_loadp |= UM_OPCODE(words[index]) == LOADP;
+        }
+        fprintf(out, "%s        switch (pc) {\n",
+                has_loadp ? "dispatch:\n" : "");
+        for (uint32_t index = 0; index < num_words; index++) {
+                fprintf(out, "        case %u: goto L%u;\n", index, index);
+        }
+        fprintf(out, "        default: goto fallback;\n        }\n\n");
+
+        for (uint32_t index = 0; index < num_words; index++) {
+                emit_word(out, words, num_words, index);
+        }
+
+        /* off the end, or anything native code can't follow */
+        fprintf(out, "        pc = %u;\n\nfallback: {\n", num_words);
+        fprintf(out, "        uint32_t registers[8] = "
+                     "{ r0, r1, r2, r3, r4, r5, r6, r7 };\n");
+        fprintf(out, "        return interpret(all_segments, io, "
+                     "registers, pc, NULL);\n");
+        fprintf(out, "}\n}\n\n");
+
+        fprintf(out, "int main()\n{\n");
+        fprintf(out, "        return native_main(image + 1, %u, run);\n",
+                num_words);
+        fprintf(out, "}\n");
+
+        if (out != stdout) {
+                int closed = fclose(out);
+                assert(closed == 0);
+                (void)closed;
+        }
+        free(words - 1);
+        return EXIT_SUCCESS;
+}
+
+
+/*      emit_image
+ * Purpose: write the program's words into the C, behind a pinned
+ *          reference count, for native_main to map as segment 0
+ * Expectations: out is open for writing
+ * Input: stream, the program's words, how many
+ * Output: N/A, void - end result: a static image array written
+ */
+static void emit_image(FILE *out, uint32_t *words, uint32_t num_words)
+{
+        fprintf(out, "static uint32_t image[] = {\n        SEG_PINNED,");
+        for (uint32_t index = 0; index < num_words; index++) {
+                if (index % IMAGE_WORDS_PER_LINE == 0) {
+                        fprintf(out, "\n       ");
+                }
+                fprintf(out, " 0x%08x,", words[index]);
+        }
+        fprintf(out, "\n};\n\n");
+}
+
+/*      emit_word
+ * Purpose: write the label & C for one word of the program
+ * Expectations: out is open for writing, index < num_words
+ * Input: stream, the program's words, how many, index of this word
+ * Output: N/A, void - end result: C for the word written
+ * Note: each word's C only depends on that word (& for LV, the word
+ *       after it), & falls through to the next word's label
+ */
+static void emit_word(FILE *out, uint32_t *words, uint32_t num_words,
+                      uint32_t index)
+{
+        uint32_t word = words[index];
+        unsigned ra = UM_RA(word), rb = UM_RB(word), rc = UM_RC(word);
+
+        fprintf(out, "L%u:\n", index);
+
+        switch (UM_OPCODE(word)) {
+        case CMOV:
+                fprintf(out, "        if (r%u != 0) r%u = r%u;\n",
+                        rc, ra, rb);
+                break;
+        case SLOAD:
+                fprintf(out, "        r%u = seg_words(all_segments, r%u)"
+                             "[r%u];\n", ra, rb, rc);
+                break;
+        case SSTORE:
+                /* Note: code has changed under us, so stop translating */
+                fprintf(out, "        native_store(all_segments, r%u, r%u, "
+                             "r%u);\n", ra, rb, rc);
+                fprintf(out, "        if (r%u == 0) { pc = %u; "
+                             "goto fallback; }\n", ra, index + 1);
+                break;
+        case ADD:
+                fprintf(out, "        r%u = r%u + r%u;\n", ra, rb, rc);
+                break;
+        case MUL:
+                fprintf(out, "        r%u = r%u * r%u;\n", ra, rb, rc);
+                break;
+        case DIV:
+                fprintf(out, "        assert(r%u != 0);\n", rc);
+                fprintf(out, "        r%u = r%u / r%u;\n", ra, rb, rc);
+                break;
+        case NAND:
+                fprintf(out, "        r%u = ~(r%u & r%u);\n", ra, rb, rc);
+                break;
+        case HALT:
+                fprintf(out, "        return EXIT_SUCCESS;\n");
+                break;
+        case ACTIVATE:
+                fprintf(out, "        r%u = map_seg(all_segments, r%u);\n",
+                        rb, rc);
+                break;
+        case INACTIVATE:
+                fprintf(out, "        unmap_seg(all_segments, r%u);\n", rc);
+                break;
+        case OUT:
+                fprintf(out, "        native_output(io, r%u);\n", rc);
+                break;
+        case IN:
+                fprintf(out, "        r%u = umio_get(io);\n", rc);
+                break;
+        case LOADP:
+                fprintf(out, "        pc = r%u;\n", rc);
+                fprintf(out, "        if (r%u != 0) {\n"
+                             "                share_seg(all_segments, 0, "
+                             "r%u);\n"
+                             "                goto fallback;\n"
+                             "        }\n", rb, rb);
+                fprintf(out, "        goto dispatch;\n");
+                break;
+        case LV: {
+                uint32_t value = UM_LV_VAL(word);
+                fprintf(out, "        r%u = %uu;\n", UM_LV_RA(word), value);
+
+                /*
+                 * LV of a jump target right before the LOADP that uses
+                 * it: jump straight there, rather than via the switch
+                 * Note: only from here; jumping to the LOADP's own label
+                 *       still takes the general path
+                 */
+                uint32_t next = index + 1 < num_words ? words[index + 1] : 0;
+                if (index + 1 < num_words && UM_OPCODE(next) == LOADP &&
+                    UM_RC(next) == UM_LV_RA(word) && value < num_words) {
+                        fprintf(out, "        if (r%u == 0) goto L%u;\n",
+                                UM_RB(next), value);
+                }
+                break;
+        }
+        default:
+                /* the interpreter reports it, as it would have anyway */
+                fprintf(out, "        pc = %u;\n        goto fallback;\n",
+                        index);
+                break;
+        }
+}
@@ -0,0 +1,377 @@
+/*
+ *              ** umasm.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Assembler for the listings umdis prints (without its
+ *             address & word columns), so test programs can be kept as
+ *             readable source & assembled at build time
+ *
+ *             Usage: ./umasm <source.uma> <program.um>
+ *
+ *             One instruction per line, as umdis names them & orders
+ *             their operands:
+ *
+ *                 cmov, sload, sstore, add, mul, div, nand  rA, rB, rC
+ *                 map rB, rC      unmap rC      out rC      in rC
+ *                 loadp rB, rC    lv rA, <value>            halt
+ *                 .word <value>   (any 32-bit word, e.g. data)
+ *
+ *             A value is a number (decimal or 0x hex), a character
+ *             ('A', '\n'), or a label: a name followed by ':' at the
+ *             start of a line, standing for the index of the next word.
+ *             ';' starts a comment that runs to the end of the line.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "assert.h"
+#include "instructions.h"
+
+
+#define MAX_LINE 256
+#define MAX_LABEL 64
+
+typedef struct Label {
+        char name[MAX_LABEL];
+        uint32_t word;
+} Label;
+
+typedef struct Source {
+        const char *path;
+        unsigned line;          /* being assembled, for errors */
+        Label *labels;
+        uint32_t num_labels;
+        uint32_t capacity;
+} Source;
+
+/* the operands each mnemonic takes, as umdis prints them */
+typedef enum Operands {
+        THREE_REGISTERS, B_AND_C, C_ONLY, NONE, REGISTER_AND_VALUE, VALUE
+} Operands;
+
+static const struct {
+        const char *name;
+        Um_opcode opcode;
+        Operands operands;
+} mnemonics[] = {
+        { "cmov",   CMOV,       THREE_REGISTERS },
+        { "sload",  SLOAD,      THREE_REGISTERS },
+        { "sstore", SSTORE,     THREE_REGISTERS },
+        { "add",    ADD,        THREE_REGISTERS },
+        { "mul",    MUL,        THREE_REGISTERS },
+        { "div",    DIV,        THREE_REGISTERS },
+        { "nand",   NAND,       THREE_REGISTERS },
+        { "halt",   HALT,       NONE },
+        { "map",    ACTIVATE,   B_AND_C },
+        { "unmap",  INACTIVATE, C_ONLY },
+        { "out",    OUT,        C_ONLY },
+        { "in",     IN,         C_ONLY },
+        { "loadp",  LOADP,      B_AND_C },
+        { "lv",     LV,         REGISTER_AND_VALUE },
+        { ".word",  0,          VALUE },
+};
+
+#define NUM_MNEMONICS (sizeof(mnemonics) / sizeof(mnemonics[0]))
+
+
+static char *take_label(Source *source, char *line, int define,
+                        uint32_t word);
+static int assemble_line(Source *source, char *text, uint32_t *word);
+static uint32_t parse_register(Source *source, char **text);
+static uint32_t parse_value(Source *source, char **text);
+static void expect_comma(Source *source, char **text);
+static void error(Source *source, const char *message, const char *what);
+
+
+/*      main
+ * Purpose: assemble a source file into a .um program
+ * Expectations: source is readable, program can be written
+ * Input: number of command line arguments, content of arguments
+ * Output: EXIT_SUCCESS once the program has been written, else
+ *         EXIT_FAILURE with the first error on stderr
+ */
+int main(int argc, char *argv[])
+{
+        if (argc != 3) {
+                fprintf(stderr, "Usage: ./umasm <source.uma> "
+                                "<program.um>\n");
+                exit(EXIT_FAILURE);
+        }
+
+        Source source = { argv[1], 0, NULL, 0, 0 };
+        FILE *in = fopen(argv[1], "r");
+        if (in == NULL) {
+                fprintf(stderr, "umasm: cannot open %s\n", argv[1]);
+                exit(EXIT_FAILURE);
+        }
+
+        /* first pass: where each label is */
+        char line[MAX_LINE];
+        uint32_t num_words = 0;
+        while (fgets(line, sizeof(line), in) != NULL) {
+                source.line++;
+                char *rest = take_label(&source, line, 1, num_words);
+                num_words += assemble_line(&source, rest, NULL);
+        }
+
+        /* second pass: the words themselves */
+        FILE *out = fopen(argv[2], "wb");
+        if (out == NULL) {
+                fprintf(stderr, "umasm: cannot create %s\n", argv[2]);
+                exit(EXIT_FAILURE);
+        }
+        rewind(in);
+        source.line = 0;
+        while (fgets(line, sizeof(line), in) != NULL) {
+                source.line++;
+                char *rest = take_label(&source, line, 0, 0);
+                uint32_t word;
+                if (assemble_line(&source, rest, &word)) {
+                        uint8_t bytes[4] = { word >> 24, word >> 16,
+                                             word >> 8, word };
+                        size_t written = fwrite(bytes, 1, 4, out);
+                        assert(written == 4);
+                        (void)written;
+                }
+        }
+
+        fclose(in);
+        int closed = fclose(out);
+        assert(closed == 0);
+        (void)closed;
+        free(source.labels);
+        return EXIT_SUCCESS;
+}
+
+/*      take_label
+ * Purpose: cut the comment off a line, & the label off its start
+ * Expectations: line is NUL-terminated
+ * Input: the source, the line, whether to define the label (first
+ *        pass), & the word it stands for
+ * Output: the rest of the line, after the label
+ */
+static char *take_label(Source *source, char *line, int define,
+                        uint32_t word)
+{
+        char *comment = strchr(line, ';');
+        if (comment != NULL) {
+                *comment = '\0';
+        }
+
+        char *name = line;
+        while (isspace((unsigned char)*name)) {
+                name++;
+        }
+        char *end = name;
+        while (isalnum((unsigned char)*end) || *end == '_') {
+                end++;
+        }
+        if (end == name || *end != ':') {
+                return line;
+        }
+
+        *end = '\0';
+        if (define) {
+                if (end - name >= MAX_LABEL) {
+                        error(source, "label too long", name);
+                }
+                for (uint32_t i = 0; i < source->num_labels; i++) {
+                        if (strcmp(source->labels[i].name, name) == 0) {
+                                error(source, "label defined twice", name);
+                        }
+                }
+                if (source->num_labels == source->capacity) {
+                        source->capacity = source->capacity
+                                         ? 2 * source->capacity : 64;
+                        source->labels = realloc(source->labels,
+                                                 sizeof(Label) *
+                                                 source->capacity);
+                        assert(source->labels != NULL);
+                }
+                Label *label = &source->labels[source->num_labels++];
+                strcpy(label->name, name);
+                label->word = word;
+        }
+        return end + 1;
+}
+
+/*      assemble_line
+ * Purpose: assemble what is left of a line, if anything
+ * Expectations: comment & label already taken off
+ * Input: the source, the text, where to put the word (NULL in the
+ *        first pass, when labels may not be known yet)
+ * Output: 1 if the line is a word, 0 if it is blank; exits on errors
+ */
+static int assemble_line(Source *source, char *text, uint32_t *word)
+{
+        while (isspace((unsigned char)*text)) {
+                text++;
+        }
+        if (*text == '\0') {
+                return 0;
+        }
+
+        char name[16];
+        int length;
+        if (sscanf(text, "%15[a-z.]%n", name, &length) != 1) {
+                error(source, "expected an instruction", text);
+        }
+        if (word == NULL) {
+                return 1;
+        }
+        text += length;
+
+        size_t i = 0;
+        while (i < NUM_MNEMONICS && strcmp(mnemonics[i].name, name) != 0) {
+                i++;
+        }
+        if (i == NUM_MNEMONICS) {
+                error(source, "unknown instruction", name);
+        }
+
+        uint32_t ra = 0, rb = 0, rc = 0;
+        *word = (uint32_t)mnemonics[i].opcode << 28;
+        switch (mnemonics[i].operands) {
+        case THREE_REGISTERS:
+                ra = parse_register(source, &text);
+                expect_comma(source, &text);
+                rb = parse_register(source, &text);
+                expect_comma(source, &text);
+                rc = parse_register(source, &text);
+                break;
+        case B_AND_C:
+                rb = parse_register(source, &text);
+                expect_comma(source, &text);
+                rc = parse_register(source, &text);
+                break;
+        case C_ONLY:
+                rc = parse_register(source, &text);
+                break;
+        case NONE:
+                break;
+        case REGISTER_AND_VALUE:
+                ra = parse_register(source, &text);
+                expect_comma(source, &text);
+                uint32_t value = parse_value(source, &text);
+                if (value >= (1u << 25)) {
+                        error(source, "value does not fit in 25 bits",
+                              name);
+                }
+                *word |= ra << 25 | value;
+                ra = 0;
+                break;
+        case VALUE:
+                *word = parse_value(source, &text);
+                break;
+        }
+        *word |= ra << 6 | rb << 3 | rc;
+
+        while (isspace((unsigned char)*text)) {
+                text++;
+        }
+        if (*text != '\0') {
+                error(source, "unexpected text", text);
+        }
+        return 1;
+}
+
+/*      parse_register
+ * Purpose: read one register operand (r0 to r7)
+ * Expectations: N/A
+ * Input: the source, where the text is (moved past the register)
+ * Output: the register's number; exits if there isn't one
+ */
+static uint32_t parse_register(Source *source, char **text)
+{
+        char *at = *text;
+        while (isspace((unsigned char)*at)) {
+                at++;
+        }
+        if (at[0] != 'r' || at[1] < '0' || at[1] > '7' ||
+            isalnum((unsigned char)at[2])) {
+                error(source, "expected a register", at);
+        }
+        *text = at + 2;
+        return at[1] - '0';
+}
+
+/*      parse_value
+ * Purpose: read one value: a number, a character, or a label
+ * Expectations: every label has been defined (second pass)
+ * Input: the source, where the text is (moved past the value)
+ * Output: the value; exits on anything else
+ */
+static uint32_t parse_value(Source *source, char **text)
+{
+        char *at = *text;
+        while (isspace((unsigned char)*at)) {
+                at++;
+        }
+
+        if (at[0] == '\'') {
+                uint32_t value = (unsigned char)at[1];
+                char *end = at + 2;
+                if (at[1] == '\\') {
+                        value = at[2] == 'n' ? '\n' :
+                                at[2] == 't' ? '\t' :
+                                at[2] == '0' ? '\0' : (unsigned char)at[2];
+                        end = at + 3;
+                }
+                if (*end != '\'') {
+                        error(source, "bad character", at);
+                }
+                *text = end + 1;
+                return value;
+        }
+
+        if (isdigit((unsigned char)at[0])) {
+                char *end;
+                unsigned long long value = strtoull(at, &end, 0);
+                if (value > UINT32_MAX) {
+                        error(source, "value does not fit in 32 bits", at);
+                }
+                *text = end;
+                return value;
+        }
+
+        char *end = at;
+        while (isalnum((unsigned char)*end) || *end == '_') {
+                end++;
+        }
+        for (uint32_t i = 0; i < source->num_labels; i++) {
+                if (strlen(source->labels[i].name) == (size_t)(end - at) &&
+                    strncmp(source->labels[i].name, at, end - at) == 0) {
+                        *text = end;
+                        return source->labels[i].word;
+                }
+        }
+        error(source, "unknown label", at);
+        return 0;
+}
+
+static void expect_comma(Source *source, char **text)
+{
+        char *at = *text;
+        while (isspace((unsigned char)*at)) {
+                at++;
+        }
+        if (*at != ',') {
+                error(source, "expected ','", at);
+        }
+        *text = at + 1;
+}
+
+/* report an error on the line being assembled, & give up */
+static void error(Source *source, const char *message, const char *what)
+{
+        fprintf(stderr, "umasm: %s:%u: %s: %s\n", source->path,
+                source->line, message, what);
+        exit(EXIT_FAILURE);
+}
@@ -0,0 +1,494 @@
+/*
+ *              ** umbatch.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Batch runner: runs every job in a manifest on a pool of
+ *             threads, each job a separate machine with its own
+ *             Segments, registers, & I/O
+ *
+ *             Usage: ./um-batch [--threads <n>] [--lockstep <lanes>]
+ *                               <manifest>
+ *
+ *             Each manifest line is "<program.um> <input> <output>",
+ *             where "-" means no input, or discarded output. Each
+ *             distinct program is loaded once & mapped, pinned, as
+ *             segment 0 of every job that runs it, so a job only gets
+ *             its own copy if it stores into its code.
+ *
+ *             With --lockstep, jobs running the same program are run in
+ *             groups of up to <lanes> at once by the Lockstep module.
+ *             Workers take a group at a time (without it, every group
+ *             is one job).
+ *
+ *             The machine is the library build's (UM_LIBRARY, like
+ *             libum's), which checks the guest on every load, store,
+ *             division & so on, so a job that faults only fails itself,
+ *             & the rest of the batch carries on.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "segment.h"
+#include "interpreter.h"
+#include "loader.h"
+#include "umio.h"
+#include "lockstep.h"
+
+
+#define NUM_REGISTERS 8
+
+/* one distinct .um file, loaded once & shared by its jobs */
+typedef struct Batch_program {
+        char *path;
+        uint32_t *words;
+        uint32_t num_words;
+} Batch_program;
+
+typedef struct Batch_job {
+        size_t program;         /* index into the programs array */
+        char *input;
+        char *output;
+        int status;
+} Batch_job;
+
+/* jobs run together: [first, first + count) of the members array */
+typedef struct Batch_group {
+        size_t first;
+        size_t count;
+} Batch_group;
+
+/*
+ * each worker's share of the groups, [head, tail) of the groups array
+ * Note: the owner takes from the tail & thieves from the head, so they
+ *       only meet once the queue is nearly empty
+ */
+typedef struct Batch_queue {
+        pthread_mutex_t lock;
+        size_t head;
+        size_t tail;
+} Batch_queue;
+
+typedef struct Batch {
+        Batch_program *programs;
+        size_t num_programs;
+        Batch_job *jobs;
+        size_t num_jobs;
+
+        /* jobs by group, each group's in manifest order */
+        Batch_group *groups;
+        size_t num_groups;
+        size_t *members;
+
+        Batch_queue *queues;
+        int num_workers;
+
+        Lockstep_stats stats;   /* added to atomically */
+} Batch;
+
+typedef struct Batch_worker {
+        Batch *batch;
+        int id;
+} Batch_worker;
+
+
+static void read_manifest(Batch *batch, const char *path);
+
+static void group_jobs(Batch *batch, int lanes);
+
+static void *worker_main(void *arg);
+
+static Batch_group *take_group(Batch *batch, int id);
+
+static void run_group(Batch *batch, Batch_group *group);
+
+static int open_job(Batch_job *job, int *in_fd, int *out_fd);
+
+
+/*      main
+ * Purpose: load the manifest & its programs, run every job on the
+ *          thread pool, then report any that failed
+ * Expectations: manifest & the programs it names exist
+ * Input: number of command line arguments, content of arguments
+ * Output: EXIT_SUCCESS if every job halted cleanly, else EXIT_FAILURE
+ */
+int main(int argc, char *argv[])
+{
+        long num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+        long lanes = 1;
+        int arg = 1;
+        while (arg + 2 < argc) {
+                if (strcmp(argv[arg], "--threads") == 0) {
+                        num_workers = strtol(argv[arg + 1], NULL, 10);
+                } else if (strcmp(argv[arg], "--lockstep") == 0) {
+                        lanes = strtol(argv[arg + 1], NULL, 10);
+                } else {
+                        break;
+                }
+                arg += 2;
+        }
+        if (arg != argc - 1 || num_workers < 1 || lanes < 1 ||
+            lanes > LOCKSTEP_MAX_LANES) {
+                fprintf(stderr, "Usage: ./um-batch [--threads <n>] "
+                                "[--lockstep <lanes>] <manifest>\n"
+                                "       (at most %d lanes)\n",
+                        LOCKSTEP_MAX_LANES);
+                exit(EXIT_FAILURE);
+        }
+
+        Batch batch;
+        memset(&batch, 0, sizeof(batch));
+        read_manifest(&batch, argv[arg]);
+        group_jobs(&batch, lanes);
+
+        /* never more workers than groups */
+        if ((size_t)num_workers > batch.num_groups) {
+                num_workers = batch.num_groups > 0 ? batch.num_groups : 1;
+        }
+        batch.num_workers = num_workers;
+
+        /* deal the groups out in contiguous runs, one per worker */
+        batch.queues = malloc(sizeof(*batch.queues) * num_workers);
+        pthread_t *threads = malloc(sizeof(*threads) * num_workers);
+        Batch_worker *workers = malloc(sizeof(*workers) * num_workers);
+        assert(batch.queues != NULL && threads != NULL && workers != NULL);
+
+        for (int id = 0; id < num_workers; id++) {
+                Batch_queue *queue = &batch.queues[id];
+                pthread_mutex_init(&queue->lock, NULL);
+                queue->head = batch.num_groups * id / num_workers;
+                queue->tail = batch.num_groups * (id + 1) / num_workers;
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (int id = 0; id < num_workers; id++) {
+                workers[id].batch = &batch;
+                workers[id].id = id;
+                int created = pthread_create(&threads[id], NULL,
+                                             worker_main, &workers[id]);
+                assert(created == 0);
+                (void)created;
+        }
+        for (int id = 0; id < num_workers; id++) {
+                pthread_join(threads[id], NULL);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double wall_s = (end.tv_sec - start.tv_sec) +
+                        (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        /* report failures in manifest order */
+        size_t failed = 0;
+        for (size_t i = 0; i < batch.num_jobs; i++) {
+                Batch_job *job = &batch.jobs[i];
+                if (job->status != EXIT_SUCCESS) {
+                        fprintf(stderr, "um-batch: job %zu (%s) failed\n",
+                                i + 1, batch.programs[job->program].path);
+                        failed++;
+                }
+        }
+        fprintf(stderr, "um-batch: %zu jobs, %zu failed, %.3fs on %ld "
+                        "threads\n", batch.num_jobs, failed, wall_s,
+                num_workers);
+        if (lanes > 1) {
+                Lockstep_stats *stats = &batch.stats;
+                fprintf(stderr, "um-batch: lockstep: %zu groups, %llu "
+                                "words in lockstep (%.1f lanes each), %llu "
+                                "jobs finished alone\n",
+                        batch.num_groups, (unsigned long long)stats->words,
+                        stats->words == 0 ? 0.0 : (double)stats->lane_words /
+                                                  stats->words,
+                        (unsigned long long)stats->left);
+        }
+
+        for (int id = 0; id < num_workers; id++) {
+                pthread_mutex_destroy(&batch.queues[id].lock);
+        }
+        for (size_t i = 0; i < batch.num_programs; i++) {
+                free(batch.programs[i].words - 1);
+                free(batch.programs[i].path);
+        }
+        for (size_t i = 0; i < batch.num_jobs; i++) {
+                free(batch.jobs[i].input);
+                free(batch.jobs[i].output);
+        }
+        free(batch.programs);
+        free(batch.jobs);
+        free(batch.groups);
+        free(batch.members);
+        free(batch.queues);
+        free(threads);
+        free(workers);
+
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/*      read_manifest
+ * Purpose: read every job from the manifest, loading each distinct
+ *          program the first time it's named
+ * Expectations: manifest exists, every line has three fields
+ * Input: batch to fill, path of the manifest
+ * Output: N/A, void - end result: batch holds the jobs & programs
+ */
+static void read_manifest(Batch *batch, const char *path)
+{
+        FILE *manifest = fopen(path, "r");
+        if (manifest == NULL) {
+                fprintf(stderr, "um-batch: cannot open %s\n", path);
+                exit(EXIT_FAILURE);
+        }
+
+        size_t jobs_capacity = 0;
+        size_t programs_capacity = 0;
+        char program[4096], input[4096], output[4096];
+
+        while (fscanf(manifest, "%4095s %4095s %4095s",
+                      program, input, output) == 3) {
+                /* Note: a linear search, as batches reuse few programs */
+                size_t index = 0;
+                while (index < batch->num_programs &&
+                       strcmp(batch->programs[index].path, program) != 0) {
+                        index++;
+                }
+
+                if (index == batch->num_programs) {
+                        if (batch->num_programs == programs_capacity) {
+                                programs_capacity = programs_capacity ?
+                                                    2 * programs_capacity : 16;
+                                batch->programs = realloc(batch->programs,
+                                        sizeof(*batch->programs) *
+                                        programs_capacity);
+                                assert(batch->programs != NULL);
+                        }
+
+                        Batch_program *loaded = &batch->programs[index];
+                        loaded->path = strdup(program);
+                        loaded->words = read_pinned_file(program,
+                                                         &loaded->num_words);
+                        batch->num_programs++;
+                }
+
+                if (batch->num_jobs == jobs_capacity) {
+                        jobs_capacity = jobs_capacity ? 2 * jobs_capacity
+                                                      : 256;
+                        batch->jobs = realloc(batch->jobs,
+                                              sizeof(*batch->jobs) *
+                                              jobs_capacity);
+                        assert(batch->jobs != NULL);
+                }
+
+                Batch_job *job = &batch->jobs[batch->num_jobs++];
+                job->program = index;
+                job->input = strdup(input);
+                job->output = strdup(output);
+                job->status = EXIT_FAILURE;
+        }
+
+        fclose(manifest);
+}
+
+/*      group_jobs
+ * Purpose: split the jobs into groups to run together: jobs running the
+ *          same program, up to lanes of them, in manifest order
+ * Expectations: manifest has been read
+ * Input: batch, most jobs in a group
+ * Output: N/A, void - end result: batch's groups & members are set up,
+ *         in order of each group's first job
+ */
+static void group_jobs(Batch *batch, int lanes)
+{
+        batch->groups = malloc(sizeof(*batch->groups) *
+                               (batch->num_jobs + 1));
+        batch->members = malloc(sizeof(*batch->members) *
+                                (batch->num_jobs + 1));
+        size_t *group_of = malloc(sizeof(*group_of) *
+                                  (batch->num_jobs + 1));
+        size_t *open = malloc(sizeof(*open) * (batch->num_programs + 1));
+        assert(batch->groups != NULL && batch->members != NULL);
+        assert(group_of != NULL && open != NULL);
+
+        /* each program's group still taking jobs, if any */
+        for (size_t program = 0; program < batch->num_programs; program++) {
+                open[program] = SIZE_MAX;
+        }
+
+        batch->num_groups = 0;
+        for (size_t i = 0; i < batch->num_jobs; i++) {
+                size_t *group = &open[batch->jobs[i].program];
+                if (*group == SIZE_MAX ||
+                    batch->groups[*group].count == (size_t)lanes) {
+                        *group = batch->num_groups++;
+                        batch->groups[*group].count = 0;
+                }
+                batch->groups[*group].count++;
+                group_of[i] = *group;
+        }
+
+        /* lay the groups out one after another, then fill them in */
+        size_t first = 0;
+        for (size_t group = 0; group < batch->num_groups; group++) {
+                batch->groups[group].first = first;
+                first += batch->groups[group].count;
+                batch->groups[group].count = 0;
+        }
+        for (size_t i = 0; i < batch->num_jobs; i++) {
+                Batch_group *group = &batch->groups[group_of[i]];
+                batch->members[group->first + group->count++] = i;
+        }
+
+        free(group_of);
+        free(open);
+}
+
+/*      worker_main
+ * Purpose: run groups of jobs until there are none left anywhere
+ * Expectations: batch's queues are set up
+ * Input: pointer to this worker's Batch_worker
+ * Output: NULL, once every queue is empty
+ */
+static void *worker_main(void *arg)
+{
+        Batch_worker *worker = arg;
+
+        Batch_group *group;
+        while ((group = take_group(worker->batch, worker->id)) != NULL) {
+                run_group(worker->batch, group);
+        }
+        return NULL;
+}
+
+/*      take_group
+ * Purpose: take the next group from this worker's own queue, or steal
+ *          one from another worker once its own is empty
+ * Expectations: batch's queues are set up
+ * Input: batch, this worker's id
+ * Output: pointer to the group, or NULL if every queue is empty
+ * Note: groups are never added once started, so one pass over the
+ *       other queues that finds nothing means the batch is done
+ */
+static Batch_group *take_group(Batch *batch, int id)
+{
+        for (int i = 0; i < batch->num_workers; i++) {
+                int victim = (id + i) % batch->num_workers;
+                Batch_queue *queue = &batch->queues[victim];
+                Batch_group *group = NULL;
+
+                pthread_mutex_lock(&queue->lock);
+                if (queue->head < queue->tail) {
+                        size_t index = victim == id ? --queue->tail
+                                                    : queue->head++;
+                        group = &batch->groups[index];
+                }
+                pthread_mutex_unlock(&queue->lock);
+
+                if (group != NULL) {
+                        return group;
+                }
+        }
+        return NULL;
+}
+
+/*      run_group
+ * Purpose: run one group of jobs to completion, each on a machine of
+ *          its own: in lockstep if there are several, else alone
+ * Expectations: the group's program has been loaded
+ * Input: batch, group to run
+ * Output: N/A, void - end result: outputs written, each job's status
+ *         set (EXIT_FAILURE for one whose files can't be opened, or
+ *         that faulted)
+ */
+static void run_group(Batch *batch, Batch_group *group)
+{
+        size_t *members = &batch->members[group->first];
+        Batch_program *program =
+                &batch->programs[batch->jobs[members[0]].program];
+        Lockstep_lane lanes[LOCKSTEP_MAX_LANES];
+        Batch_job *jobs[LOCKSTEP_MAX_LANES];
+        int in_fds[LOCKSTEP_MAX_LANES], out_fds[LOCKSTEP_MAX_LANES];
+        int num_lanes = 0;
+
+        for (size_t i = 0; i < group->count; i++) {
+                Batch_job *job = &batch->jobs[members[i]];
+                if (!open_job(job, &in_fds[num_lanes],
+                              &out_fds[num_lanes])) {
+                        job->status = EXIT_FAILURE;
+                        continue;
+                }
+
+                /* segment 0 is the shared program, until stored to */
+                Lockstep_lane *lane = &lanes[num_lanes];
+                lane->all_segments = segments_initialize();
+                map_pinned_seg(lane->all_segments, program->words,
+                               program->num_words);
+                lane->io = umio_new(in_fds[num_lanes], out_fds[num_lanes],
+                                    0, 0, 0);
+                jobs[num_lanes++] = job;
+        }
+
+        if (num_lanes == 1) {
+                uint32_t registers[NUM_REGISTERS] = { 0 };
+                lanes[0].status = interpret_guarded(lanes[0].all_segments,
+                                                    lanes[0].io, registers,
+                                                    0, NULL);
+        } else if (num_lanes > 1) {
+                Lockstep_stats stats = { 0, 0, 0 };
+                lockstep_run(program->words, program->num_words, lanes,
+                             num_lanes, &stats);
+                __atomic_fetch_add(&batch->stats.words, stats.words,
+                                   __ATOMIC_RELAXED);
+                __atomic_fetch_add(&batch->stats.lane_words,
+                                   stats.lane_words, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&batch->stats.left, stats.left,
+                                   __ATOMIC_RELAXED);
+        }
+
+        for (int lane = 0; lane < num_lanes; lane++) {
+                jobs[lane]->status = lanes[lane].status;
+                umio_free(lanes[lane].io);
+                segments_free(lanes[lane].all_segments);
+                close(in_fds[lane]);
+                close(out_fds[lane]);
+        }
+}
+
+/*      open_job
+ * Purpose: open a job's input & output files
+ * Expectations: N/A
+ * Input: the job, pointers to fill with its input & output descriptors
+ * Output: 1 if both opened, else 0 (with neither left open, & the
+ *         failure reported)
+ */
+static int open_job(Batch_job *job, int *in_fd, int *out_fd)
+{
+        const char *input = strcmp(job->input, "-") == 0 ? "/dev/null"
+                                                         : job->input;
+        const char *output = strcmp(job->output, "-") == 0 ? "/dev/null"
+                                                           : job->output;
+        *in_fd = open(input, O_RDONLY);
+        *out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (*in_fd >= 0 && *out_fd >= 0) {
+                return 1;
+        }
+
+        fprintf(stderr, "um-batch: cannot open %s\n",
+                *in_fd < 0 ? input : output);
+        if (*in_fd >= 0) {
+                close(*in_fd);
+        }
+        if (*out_fd >= 0) {
+                close(*out_fd);
+        }
+        return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ *              ** umbench.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Benchmark runner: times the um binary on each workload in
+ *             a umgen manifest, & prints one JSON object per workload
+ *             with its wall time, instructions per second, & peak RSS
+ *
+ *             Usage: ./umbench <manifest> <um_binary> [um options...]
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "assert.h"
+
+
+/* runs per workload; the median & the best are both reported */
+#define BENCH_RUNS 5
+
+typedef struct Run {
+        double wall_s;
+        long peak_rss_kb;
+        int status;
+} Run;
+
+
+static Run run_once(char *um, char **um_options, int num_options,
+                    char *program);
+
+static int compare_runs(const void *a, const void *b);
+
+
+/*      main
+ * Purpose: time every workload in the manifest BENCH_RUNS times
+ * Expectations: manifest was written by umgen, um binary exists
+ * Input: number of command line arguments, content of arguments
+ * Output: EXIT_SUCCESS if every run halted cleanly, else EXIT_FAILURE
+ */
+int main(int argc, char *argv[])
+{
+        if (argc < 3) {
+                fprintf(stderr, "Usage: ./umbench <manifest> <um_binary> "
+                                "[um options...]\n");
+                exit(EXIT_FAILURE);
+        }
+
+        FILE *manifest = fopen(argv[1], "r");
+        if (manifest == NULL) {
+                fprintf(stderr, "umbench: cannot open %s\n", argv[1]);
+                exit(EXIT_FAILURE);
+        }
+
+        char name[256];
+        char path[4096];
+        unsigned long long instructions;
+        int status = EXIT_SUCCESS;
+
+        while (fscanf(manifest, "%255s %4095s %llu",
+                      name, path, &instructions) == 3) {
+                Run runs[BENCH_RUNS];
+                for (int i = 0; i < BENCH_RUNS; i++) {
+                        runs[i] = run_once(argv[2], argv + 3, argc - 3, path);
+                        if (runs[i].status != 0) {
+                                status = EXIT_FAILURE;
+                        }
+                }
+                qsort(runs, BENCH_RUNS, sizeof(runs[0]), compare_runs);
+
+                Run *median = &runs[BENCH_RUNS / 2];
+                long peak_rss_kb = 0;
+                for (int i = 0; i < BENCH_RUNS; i++) {
+                        if (runs[i].peak_rss_kb > peak_rss_kb) {
+                                peak_rss_kb = runs[i].peak_rss_kb;
+                        }
+                }
+
+                printf("{\"workload\": \"%s\", \"instructions\": %llu, "
+                       "\"runs\": %d, \"wall_s\": %.6f, \"wall_min_s\": %.6f, "
+                       "\"ips\": %.0f, \"peak_rss_kb\": %ld, "
+                       "\"exit_status\": %d}\n",
+                       name, instructions, BENCH_RUNS, median->wall_s,
+                       runs[0].wall_s, instructions / median->wall_s,
+                       peak_rss_kb, median->status);
+                fflush(stdout);
+        }
+
+        fclose(manifest);
+        return status;
+}
+
+
+/*      run_once
+ * Purpose: run the um binary on one program, with no input & output
+ *          discarded, & measure it
+ * Expectations: um binary exists & is executable
+ * Input: path of um, options to pass it (& how many), .um program path
+ * Output: Run with wall time, the child's peak RSS, & its exit status
+ */
+static Run run_once(char *um, char **um_options, int num_options,
+                    char *program)
+{
+        Run run = { 0.0, 0, -1 };
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+                int null_fd = open("/dev/null", O_RDWR);
+                dup2(null_fd, STDIN_FILENO);
+                dup2(null_fd, STDOUT_FILENO);
+
+                char **args = malloc(sizeof(*args) * (num_options + 3));
+                assert(args != NULL);
+                args[0] = um;
+                for (int i = 0; i < num_options; i++) {
+                        args[i + 1] = um_options[i];
+                }
+                args[num_options + 1] = program;
+                args[num_options + 2] = NULL;
+
+                execv(um, args);
+                _exit(127);
+        }
+
+        int wait_status;
+        struct rusage usage;
+        pid_t waited = wait4(pid, &wait_status, 0, &usage);
+        assert(waited == pid);
+        (void)waited;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        run.wall_s = (end.tv_sec - start.tv_sec) +
+                     (end.tv_nsec - start.tv_nsec) / 1e9;
+        run.peak_rss_kb = usage.ru_maxrss;
+        run.status = WIFEXITED(wait_status) ? WEXITSTATUS(wait_status)
+                                            : 128 + WTERMSIG(wait_status);
+        return run;
+}
+
+/* order runs by wall time, fastest first */
+static int compare_runs(const void *a, const void *b)
+{
+        double wall_a = ((const Run *)a)->wall_s;
+        double wall_b = ((const Run *)b)->wall_s;
+        return (wall_a > wall_b) - (wall_a < wall_b);
+}
@@ -0,0 +1,175 @@
+/*
+ *              ** umdis.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Disassembler & analyzer: prints a .um program's words as
+ *             instructions, split into the basic blocks the Analysis
+ *             module recovers, with known Load Program targets & the
+ *             stores that may change code marked
+ *
+ *             Usage: ./umdis [--summary] <program.um>
+ *
+ *             Words no path from word 0 reaches are shown as .word
+ *             (they are usually data), unless some jump's target is
+ *             unknown, in which case anything may run & every word is
+ *             shown as an instruction.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "instructions.h"
+#include "loader.h"
+#include "analysis.h"
+
+
+static void print_summary(Um_analysis analysis, FILE *fp);
+
+static void print_word(Um_analysis analysis, uint32_t *words,
+                       uint32_t index, FILE *fp);
+
+
+/*      main
+ * Purpose: analyze the program & print it (or just the summary)
+ * Expectations: program is a .um file
+ * Input: number of command line arguments, content of arguments
+ * Output: EXIT_SUCCESS once printed
+ */
+int main(int argc, char *argv[])
+{
+        int summary_only = argc == 3 && strcmp(argv[1], "--summary") == 0;
+        if (argc != 2 + summary_only) {
+                fprintf(stderr, "Usage: ./umdis [--summary] <program.um>\n");
+                exit(EXIT_FAILURE);
+        }
+
+        uint32_t num_words;
+        uint32_t *words = read_pinned_file(argv[argc - 1], &num_words);
+        Um_analysis analysis = analyze_program(words, num_words, 0);
+
+        print_summary(analysis, stdout);
+        if (!summary_only) {
+                for (uint32_t index = 0; index < num_words; index++) {
+                        print_word(analysis, words, index, stdout);
+                }
+        }
+
+        analysis_free(analysis);
+        free(words - 1);
+        return EXIT_SUCCESS;
+}
+
+
+/*      print_summary
+ * Purpose: print what the analysis found, as comments
+ * Expectations: fp is open
+ * Input: the analysis, stream
+ * Output: N/A, void - end result: summary lines written
+ */
+static void print_summary(Um_analysis analysis, FILE *fp)
+{
+        uint32_t reached = 0;
+        for (uint32_t index = 0; index < analysis->num_words; index++) {
+                reached += (analysis->flags[index] & ANALYSIS_REACHED) != 0;
+        }
+
+        fprintf(fp, "; %u words, %u reached from word %u, %u blocks, "
+                    "%u known jump targets\n", analysis->num_words, reached,
+                analysis->entry, analysis->num_blocks,
+                analysis->num_targets);
+        if (analysis->unknown_jumps) {
+                fprintf(fp, "; some Load Program targets are unknown: "
+                            "any word may run\n");
+        }
+        if (analysis->no_self_mod) {
+                fprintf(fp, "; no self-modification: proven\n");
+        } else {
+                fprintf(fp, "; no self-modification: not proven (%u "
+                            "stores may hit segment 0)\n",
+                        analysis->code_stores);
+        }
+}
+
+/*      print_word
+ * Purpose: print one word, as an instruction or as data, with a label
+ *          if it starts a block & notes on anything flagged
+ * Expectations: index < the number of words analyzed, fp is open
+ * Input: the analysis, the program's words, index of this word, stream
+ * Output: N/A, void - end result: the word's line(s) written
+ */
+static void print_word(Um_analysis analysis, uint32_t *words,
+                       uint32_t index, FILE *fp)
+{
+        static const char *const names[] = {
+                [CMOV] = "cmov", [SLOAD] = "sload", [SSTORE] = "sstore",
+                [ADD] = "add", [MUL] = "mul", [DIV] = "div",
+                [NAND] = "nand", [HALT] = "halt", [ACTIVATE] = "map",
+                [INACTIVATE] = "unmap", [OUT] = "out", [IN] = "in",
+                [LOADP] = "loadp", [LV] = "lv"
+        };
+        uint32_t word = words[index];
+        uint32_t opcode = UM_OPCODE(word);
+        uint8_t flags = analysis->flags[index];
+        char operands[32];
+
+        if (flags & ANALYSIS_LEADER) {
+                fprintf(fp, "\nL%u:%s\n", index,
+                        index == analysis->entry ? "\t\t; entry" : "");
+        }
+
+        int as_code = (flags & ANALYSIS_REACHED) || analysis->unknown_jumps;
+        if (!as_code || opcode > LV) {
+                fprintf(fp, "  %08x  %08x  .word   0x%08x\n", index, word,
+                        word);
+                return;
+        }
+
+        /* operands as the instruction uses them */
+        switch (opcode) {
+        case HALT:
+                operands[0] = '\0';
+                break;
+        case ACTIVATE:
+                sprintf(operands, "r%u, r%u", UM_RB(word), UM_RC(word));
+                break;
+        case INACTIVATE:
+        case OUT:
+        case IN:
+                sprintf(operands, "r%u", UM_RC(word));
+                break;
+        case LOADP:
+                sprintf(operands, "r%u, r%u", UM_RB(word), UM_RC(word));
+                break;
+        case LV:
+                sprintf(operands, "r%u, %u", UM_LV_RA(word), UM_LV_VAL(word));
+                break;
+        default:
+                sprintf(operands, "r%u, r%u, r%u", UM_RA(word), UM_RB(word),
+                        UM_RC(word));
+                break;
+        }
+        fprintf(fp, "  %08x  %08x  %-7s %-14s", index, word, names[opcode],
+                operands);
+
+        /* notes */
+        Analysis_targets *targets = &analysis->targets[index];
+        for (uint32_t i = 0; i < targets->count; i++) {
+                fprintf(fp, "%s L%u", i == 0 ? " ; ->" : ",",
+                        targets->words[i]);
+        }
+        if (flags & ANALYSIS_UNKNOWN) {
+                fprintf(fp, " ; -> ?");
+        }
+        if (flags & ANALYSIS_LOADS_CODE) {
+                fprintf(fp, " ; may load new code");
+        }
+        if (flags & ANALYSIS_STORES_CODE) {
+                fprintf(fp, " ; ! may store into segment 0");
+        }
+        fprintf(fp, "\n");
+}
@@ -0,0 +1,348 @@
+/*
+ *              ** umgen.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Benchmark workload generator: writes a fixed set of .um
+ *             programs, & a manifest giving each one's exact number of
+ *             executed instructions, for umbench to time
+ *
+ *             Usage: ./umgen <output_dir> [scale]
+ *
+ *             Every loop below is straight-line code closed by a
+ *             conditional backward jump, so each of its words runs once
+ *             per iteration & the instruction counts are exact.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "instructions.h"
+
+
+/*
+ * register conventions in generated code
+ * Note: r0 is always 0 (so LOADP r0 is a jump), r5 is always ~0 (so
+ *       ADD rX rX r5 decrements), r1 is the loop counter, & r6/r7 are
+ *       scratch for jumps
+ */
+#define R_ZERO 0
+#define R_COUNT 1
+#define R_MINUS_ONE 5
+#define R_T1 6
+#define R_T2 7
+
+typedef struct Program {
+        uint32_t *words;
+        uint32_t length;
+        uint32_t capacity;
+} Program;
+
+typedef struct Workload {
+        const char *name;
+        uint64_t (*build)(Program *program, uint32_t iterations);
+        uint32_t iterations;    /* at scale 1 */
+} Workload;
+
+
+static uint64_t build_arith(Program *program, uint32_t iterations);
+static uint64_t build_churn(Program *program, uint32_t iterations);
+static uint64_t build_loadp(Program *program, uint32_t iterations);
+static uint64_t build_selfmod(Program *program, uint32_t iterations);
+static uint64_t build_output(Program *program, uint32_t iterations);
+
+static const Workload workloads[] = {
+        { "arith",   build_arith,   10000000 },
+        { "churn",   build_churn,    2000000 },
+        { "loadp",   build_loadp,    2000000 },
+        { "selfmod", build_selfmod,  4000000 },
+        { "output",  build_output,   5000000 },
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static void write_program(Program *program, const char *path);
+
+
+/*      main
+ * Purpose: build every workload & write it, plus the manifest, into
+ *          the output directory
+ * Expectations: output directory can be created (or already exists)
+ * Input: number of command line arguments, content of arguments
+ * Output: EXIT_SUCCESS once everything has been written
+ */
+int main(int argc, char *argv[])
+{
+        if (argc != 2 && argc != 3) {
+                fprintf(stderr, "Usage: ./umgen <output_dir> [scale]\n");
+                exit(EXIT_FAILURE);
+        }
+
+        const char *dir = argv[1];
+        double scale = argc == 3 ? strtod(argv[2], NULL) : 1.0;
+        assert(scale > 0);
+        mkdir(dir, 0777);
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/workloads.txt", dir);
+        FILE *manifest = fopen(path, "w");
+        assert(manifest != NULL);
+
+        for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+                const Workload *workload = &workloads[i];
+                uint32_t iterations = workload->iterations * scale;
+                if (iterations == 0) {
+                        iterations = 1;
+                }
+                /* Note: loop counters are loaded with a 25-bit LV */
+                assert(iterations < (1u << 25));
+
+                Program program = { NULL, 0, 0 };
+                uint64_t count = workload->build(&program, iterations);
+
+                snprintf(path, sizeof(path), "%s/%s.um", dir, workload->name);
+                write_program(&program, path);
+                fprintf(manifest, "%s %s %llu\n", workload->name, path,
+                        (unsigned long long)count);
+                free(program.words);
+        }
+
+        fclose(manifest);
+        return EXIT_SUCCESS;
+}
+
+
+/*
+ * Emitters: append one instruction (or a fixed idiom) to a program
+ */
+
+static void emit(Program *program, uint32_t word)
+{
+        if (program->length == program->capacity) {
+                program->capacity = program->capacity ? 2 * program->capacity
+                                                      : 256;
+                program->words = realloc(program->words,
+                                         sizeof(uint32_t) * program->capacity);
+                assert(program->words != NULL);
+        }
+        program->words[program->length++] = word;
+}
+
+static uint32_t encode(Um_opcode opcode, uint32_t ra, uint32_t rb,
+                       uint32_t rc)
+{
+        return (uint32_t)opcode << 28 | ra << 6 | rb << 3 | rc;
+}
+
+static uint32_t encode_lv(uint32_t ra, uint32_t val)
+{
+        assert(val < (1u << 25));
+        return (uint32_t)LV << 28 | ra << 25 | val;
+}
+
+static void op(Program *program, Um_opcode opcode,
+               uint32_t ra, uint32_t rb, uint32_t rc)
+{
+        emit(program, encode(opcode, ra, rb, rc));
+}
+
+static void lv(Program *program, uint32_t ra, uint32_t val)
+{
+        emit(program, encode_lv(ra, val));
+}
+
+/* r0 = 0, r5 = ~0, r1 = iterations: 3 instructions */
+static void prologue(Program *program, uint32_t iterations)
+{
+        lv(program, R_ZERO, 0);
+        op(program, NAND, R_MINUS_ONE, R_ZERO, R_ZERO);
+        lv(program, R_COUNT, iterations);
+}
+
+/*
+ * decrement r1 & jump back to top while it's nonzero: 5 instructions,
+ * all of which run whether or not the jump is taken
+ */
+static void loop_back(Program *program, uint32_t top)
+{
+        op(program, ADD, R_COUNT, R_COUNT, R_MINUS_ONE);
+        lv(program, R_T1, program->length + 4);
+        lv(program, R_T2, top);
+        op(program, CMOV, R_T1, R_T2, R_COUNT);
+        op(program, LOADP, 0, R_ZERO, R_T1);
+}
+
+/* output the low byte of a register, so runs can be checked: 4 words */
+static void checksum(Program *program, uint32_t reg)
+{
+        lv(program, R_T1, 0xff);
+        op(program, NAND, R_T1, R_T1, reg);
+        op(program, NAND, R_T1, R_T1, R_T1);
+        op(program, OUT, 0, 0, R_T1);
+}
+
+/* total instructions for a prologue, a loop, & an epilogue */
+static uint64_t count_loop(uint32_t top, uint32_t bottom, uint32_t end,
+                           uint32_t iterations)
+{
+        return top + (uint64_t)(bottom - top) * iterations + (end - bottom);
+}
+
+
+/*      build_arith
+ * Purpose: arithmetic kernel: multiply/add/mask in registers only
+ */
+static uint64_t build_arith(Program *program, uint32_t iterations)
+{
+        prologue(program, iterations);
+        lv(program, 2, 1);
+        lv(program, 3, 7);
+
+        uint32_t top = program->length;
+        op(program, MUL, 2, 2, 3);
+        op(program, ADD, 2, 2, R_COUNT);
+        lv(program, 4, 0xfffff);
+        op(program, NAND, 4, 4, 2);
+        op(program, NAND, 2, 4, 4);
+        op(program, DIV, 4, 2, 3);
+        op(program, ADD, 2, 2, 4);
+        loop_back(program, top);
+        uint32_t bottom = program->length;
+
+        checksum(program, 2);
+        op(program, HALT, 0, 0, 0);
+        return count_loop(top, bottom, program->length, iterations);
+}
+
+/*      build_churn
+ * Purpose: map/unmap churn: two short-lived segments per iteration,
+ *          of sizes that cycle through 1-64 words, each written & read
+ */
+static uint64_t build_churn(Program *program, uint32_t iterations)
+{
+        prologue(program, iterations);
+
+        uint32_t top = program->length;
+        lv(program, 3, 63);
+        op(program, NAND, 3, 3, R_COUNT);
+        op(program, NAND, 3, 3, 3);             /* r3 = r1 & 63 */
+        lv(program, 4, 1);
+        op(program, ADD, 3, 3, 4);              /* r3 = size, 1-64 */
+        op(program, ACTIVATE, 0, 2, 3);         /* r2 = map(r3) */
+        op(program, ACTIVATE, 0, 4, 3);         /* r4 = map(r3) */
+        op(program, SSTORE, 2, R_ZERO, R_COUNT);
+        op(program, SLOAD, 3, 2, R_ZERO);
+        op(program, SSTORE, 4, R_ZERO, 3);
+        op(program, INACTIVATE, 0, 0, 2);
+        op(program, INACTIVATE, 0, 0, 4);
+        loop_back(program, top);
+        uint32_t bottom = program->length;
+
+        checksum(program, 3);
+        op(program, HALT, 0, 0, 0);
+        return count_loop(top, bottom, program->length, iterations);
+}
+
+/*      build_loadp
+ * Purpose: LOADP-heavy control flow: a ladder of tiny blocks, each of
+ *          which jumps (LOADP of segment 0) to the next
+ */
+static uint64_t build_loadp(Program *program, uint32_t iterations)
+{
+        const uint32_t rungs = 16;
+        prologue(program, iterations);
+        lv(program, 4, 3);
+
+        /* each rung is ADD, LV, LOADP: 3 words */
+        uint32_t top = program->length;
+        for (uint32_t rung = 0; rung < rungs; rung++) {
+                op(program, ADD, 3, 3, 4);
+                lv(program, R_T1, program->length + 2);
+                op(program, LOADP, 0, R_ZERO, R_T1);
+        }
+        loop_back(program, top);
+        uint32_t bottom = program->length;
+
+        checksum(program, 3);
+        op(program, HALT, 0, 0, 0);
+        return count_loop(top, bottom, program->length, iterations);
+}
+
+/*      build_selfmod
+ * Purpose: self-modifying code: every iteration rewrites an LV inside
+ *          the loop (to load the low bits of the counter) & then runs it
+ */
+static uint64_t build_selfmod(Program *program, uint32_t iterations)
+{
+        prologue(program, iterations);
+
+        /* r3 = the LV r2 opcode bits, built as 0xD4 << 24 */
+        lv(program, 3, 0xD4);
+        lv(program, 4, 1 << 24);
+        op(program, MUL, 3, 3, 4);
+
+        uint32_t top = program->length;
+        lv(program, 4, 0xffff);
+        op(program, NAND, 4, 4, R_COUNT);
+        op(program, NAND, 4, 4, 4);             /* r4 = r1 & 0xffff */
+        op(program, ADD, 4, 4, 3);              /* r4 = LV r2, r4 */
+        lv(program, R_T1, program->length + 2);
+        op(program, SSTORE, R_ZERO, R_T1, 4);
+        lv(program, 2, 0);                      /* patched each time */
+        op(program, ADD, 7, 7, 2);
+        loop_back(program, top);
+        uint32_t bottom = program->length;
+
+        checksum(program, 7);
+        op(program, HALT, 0, 0, 0);
+        return count_loop(top, bottom, program->length, iterations);
+}
+
+/*      build_output
+ * Purpose: output-heavy: a line of text per few iterations
+ */
+static uint64_t build_output(Program *program, uint32_t iterations)
+{
+        prologue(program, iterations);
+        lv(program, 2, 'u');
+        lv(program, 3, 'm');
+        lv(program, 4, '\n');
+
+        uint32_t top = program->length;
+        op(program, OUT, 0, 0, 2);
+        op(program, OUT, 0, 0, 3);
+        op(program, OUT, 0, 0, 4);
+        loop_back(program, top);
+        uint32_t bottom = program->length;
+
+        op(program, HALT, 0, 0, 0);
+        return count_loop(top, bottom, program->length, iterations);
+}
+
+
+/*      write_program
+ * Purpose: write a program as a .um file (big-endian words)
+ * Expectations: path can be created
+ * Input: program to write, path of the .um file
+ * Output: N/A, void - end result: file written
+ */
+static void write_program(Program *program, const char *path)
+{
+        FILE *fp = fopen(path, "wb");
+        assert(fp != NULL);
+
+        for (uint32_t i = 0; i < program->length; i++) {
+                uint32_t word = program->words[i];
+                uint8_t bytes[4] = { word >> 24, word >> 16, word >> 8, word };
+                size_t written = fwrite(bytes, 1, 4, fp);
+                assert(written == 4);
+                (void)written;
+        }
+
+        fclose(fp);
+}
@@ -0,0 +1,605 @@
+/*
+ *              ** umio.c **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: Implementation of the Umio interface,
+ *             with all relevant functions and libraries
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "umio.h"
+
+
+/* 
+ * Async mode: a reader thread read()s input into one ring & a writer
+ * thread write()s output from another, so the guest only waits when it
+ * needs a byte that hasn't arrived (or output is a whole ring behind).
+ * Each ring has one producer & one consumer, which share nothing but
+ * the two indices; a side only takes the lock to sleep on an empty (or
+ * full) ring, or to wake the other side up from one.
+ */
+#define UMIO_RING_SIZE (1024 * 1024)
+
+typedef struct Umio_ring {
+        uint8_t *bytes;
+
+        /* 
+         * bytes consumed & produced so far, used mod UMIO_RING_SIZE
+         * Note: head is only written by the consumer, tail only by the
+         *       producer; the ring is empty when they are equal
+         */
+        size_t head;
+        size_t tail;
+
+        /* set once either side is done with the ring */
+        int closed;
+
+        /* threads asleep in ring_sleep, & what they sleep on */
+        int sleepers;
+        pthread_mutex_t lock;
+        pthread_cond_t wake;
+
+        /* the thread serving the ring, & the descriptor it serves */
+        pthread_t thread;
+        int fd;
+} Umio_ring;
+
+
+static uint64_t now_ns();
+
+static Umio_ring *ring_new(int fd, void *(*thread_main)(void *));
+
+static void ring_free(Umio_ring *ring);
+
+static void ring_sleep(Umio_ring *ring, size_t *index, size_t seen);
+
+static void ring_wake(Umio_ring *ring);
+
+static uint32_t ring_fill(Um_io io);
+
+static void ring_flush(Um_io io);
+
+static void *reader_main(void *arg);
+
+static void *writer_main(void *arg);
+
+static long read_some(Um_io io);
+
+
+/*      umio_new
+ * Purpose: set up buffered I/O over a pair of file descriptors
+ * Expectations: file descriptors are open for reading / writing
+ * Input: input & output file descriptors, whether to flush at every
+ *        newline, flush interval in milliseconds (0 for none), whether
+ *        to do the reading & writing on threads of their own
+ * Output: new Um_io with empty buffers
+ */
+Um_io umio_new(int in_fd, int out_fd, int interactive,
+               uint64_t flush_interval_ms, int async)
+{
+        Um_io io = malloc(sizeof(*io));
+        assert(io != NULL);
+
+        io->in_fd = in_fd;
+        io->out_fd = out_fd;
+
+        io->in_buf = malloc(UMIO_BUFFER_SIZE);
+        io->out_buf = malloc(UMIO_BUFFER_SIZE);
+        assert(io->in_buf != NULL && io->out_buf != NULL);
+        io->in_pos = io->in_len = 0;
+        io->in_eof = 0;
+        io->out_len = 0;
+
+        io->interactive = interactive;
+        io->flush_interval_ns = flush_interval_ms * 1000000;
+        io->last_flush_ns = io->flush_interval_ns ? now_ns() : 0;
+
+        io->in_ring = async ? ring_new(in_fd, reader_main) : NULL;
+        io->out_ring = async ? ring_new(out_fd, writer_main) : NULL;
+
+        io->reader = NULL;
+        io->writer = NULL;
+        io->context = NULL;
+        return io;
+}
+
+/*      umio_new_callbacks
+ * Purpose: set up buffered I/O over a pair of callbacks, rather than
+ *          file descriptors
+ * Expectations: N/A
+ * Input: reader & writer (see Umio_reader & Umio_writer), context to
+ *        pass both
+ * Output: new Um_io with empty buffers, flushed only when full, before
+ *         waiting on input, & when asked
+ * Note: a reader that returns UMIO_AGAIN must only be used by callers
+ *       that check umio_ready before each Input (as slices do)
+ */
+Um_io umio_new_callbacks(Umio_reader reader, Umio_writer writer,
+                         void *context)
+{
+        assert(reader != NULL && writer != NULL);
+
+        Um_io io = umio_new(-1, -1, 0, 0, 0);
+        io->reader = reader;
+        io->writer = writer;
+        io->context = context;
+        return io;
+}
+
+/*      umio_ready
+ * Purpose: find out whether the next byte of input can be had without
+ *          waiting, fetching more if need be
+ * Expectations: io exists
+ * Input: Um_io
+ * Output: 1 if umio_get won't wait (a byte is buffered, or input has
+ *         ended), 0 if a callback reader has nothing ready yet
+ * Note: with descriptors, read() waits, so that's always 1
+ */
+int umio_ready(Um_io io)
+{
+        assert(io != NULL);
+        if (io->in_pos < io->in_len || io->in_eof || io->reader == NULL) {
+                return 1;
+        }
+
+        umio_flush(io);
+        long n = read_some(io);
+        if (n == UMIO_AGAIN) {
+                return 0;
+        } else if (n <= 0) {
+                io->in_eof = 1;
+        } else {
+                io->in_len = n;
+                io->in_pos = 0;
+        }
+        return 1;
+}
+
+/*      umio_flush
+ * Purpose: write out everything the guest has output so far
+ * Expectations: io exists
+ * Input: Um_io
+ * Output: N/A, void - end result: output buffer empty; output is
+ *         dropped if the descriptor stops accepting it (e.g. a closed
+ *         pipe), as putchar would have
+ * Note: in async mode the output goes to the writer thread instead
+ */
+void umio_flush(Um_io io)
+{
+        assert(io != NULL);
+
+        if (io->out_ring != NULL) {
+                ring_flush(io);
+                return;
+        } else if (io->writer != NULL) {
+                if (io->out_len > 0) {
+                        io->writer(io->context, io->out_buf, io->out_len);
+                }
+                io->out_len = 0;
+                return;
+        }
+
+        size_t written = 0;
+        while (written < io->out_len) {
+                ssize_t n = write(io->out_fd, io->out_buf + written,
+                                  io->out_len - written);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                } else if (n <= 0) {
+                        break;
+                }
+                written += n;
+        }
+
+        io->out_len = 0;
+        if (io->flush_interval_ns != 0) {
+                io->last_flush_ns = now_ns();
+        }
+}
+
+/*      umio_flush_due
+ * Purpose: flush pending output once the flush interval has passed, for
+ *          callers to check between Outputs (e.g. at every jump), so
+ *          output that is followed by a long silence is still written
+ * Expectations: io exists
+ * Input: Um_io
+ * Output: N/A, void - end result: output buffer flushed if there is a
+ *         flush interval, it has passed, & anything is pending
+ */
+void umio_flush_due(Um_io io)
+{
+        assert(io != NULL);
+
+        if (io->flush_interval_ns != 0 && io->out_len > 0 &&
+            now_ns() - io->last_flush_ns >= io->flush_interval_ns) {
+                umio_flush(io);
+        }
+}
+
+/*      umio_free
+ * Purpose: flush any pending output, then free the buffers
+ * Expectations: io exists
+ * Input: Um_io
+ * Output: N/A, void - end result: io freed (descriptors stay open)
+ * Note: in async mode, waits for the writer to write everything, & stops
+ *       the reader (which may be blocked in read())
+ */
+void umio_free(Um_io io)
+{
+        assert(io != NULL);
+
+        umio_flush(io);
+        if (io->out_ring != NULL) {
+                ring_free(io->out_ring);
+                ring_free(io->in_ring);
+        }
+        free(io->in_buf);
+        free(io->out_buf);
+        free(io);
+}
+
+/*      umio_put_slow
+ * Purpose: queue a byte when the buffer is nearly full, or when the
+ *          policy asks for flushes other than on a full buffer
+ * Expectations: io exists
+ * Input: Um_io, byte to write
+ * Output: N/A, void - end result: byte buffered, & buffer flushed if
+ *         full, at a newline in interactive mode, or when the flush
+ *         interval has passed
+ */
+void umio_put_slow(Um_io io, uint8_t byte)
+{
+        io->out_buf[io->out_len++] = byte;
+
+        if (io->out_len == UMIO_BUFFER_SIZE ||
+            (io->interactive && byte == '\n')) {
+                umio_flush(io);
+        } else {
+                umio_flush_due(io);
+        }
+}
+
+/*      umio_fill
+ * Purpose: refill the input buffer with one large read(), once the
+ *          guest has used up what was there
+ * Expectations: io exists, input buffer is empty
+ * Input: Um_io
+ * Output: next byte of input, or UMIO_EOF at end of input (or error)
+ * Note: pending output is flushed first, since the guest may be about
+ *       to wait on a reply to it
+ */
+uint32_t umio_fill(Um_io io)
+{
+        if (io->in_eof) {
+                return UMIO_EOF;
+        }
+
+        umio_flush(io);
+        if (io->in_ring != NULL) {
+                return ring_fill(io);
+        }
+
+        /* Note: a reader with nothing ready here has nothing for good */
+        long n = read_some(io);
+        if (n <= 0) {
+                io->in_eof = 1;
+                return UMIO_EOF;
+        }
+
+        io->in_len = n;
+        io->in_pos = 1;
+        return io->in_buf[0];
+}
+
+
+/*      read_some
+ * Purpose: read as much input as is ready into the empty buffer
+ * Expectations: io exists, not in async mode
+ * Input: Um_io
+ * Output: bytes read, 0 at end of input, negative on an error (or
+ *         UMIO_AGAIN, from a reader with nothing ready yet)
+ */
+static long read_some(Um_io io)
+{
+        if (io->reader != NULL) {
+                long n = io->reader(io->context, io->in_buf,
+                                    UMIO_BUFFER_SIZE);
+                assert(n <= UMIO_BUFFER_SIZE);
+                return n;
+        }
+
+        ssize_t n;
+        do {
+                n = read(io->in_fd, io->in_buf, UMIO_BUFFER_SIZE);
+        } while (n < 0 && errno == EINTR);
+        return n;
+}
+
+/*      now_ns
+ * Purpose: read a cheap monotonic clock for the flush interval
+ * Expectations: N/A
+ * Input: N/A, none
+ * Output: nanoseconds since an arbitrary fixed point
+ */
+static uint64_t now_ns()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*      ring_new
+ * Purpose: create one of the async rings & start the thread that
+ *          serves it
+ * Expectations: descriptor is open
+ * Input: descriptor to read from or write to, the thread's function
+ *        (reader_main or writer_main)
+ * Output: new, empty ring, with its thread running
+ */
+static Umio_ring *ring_new(int fd, void *(*thread_main)(void *))
+{
+        Umio_ring *ring = calloc(1, sizeof(*ring));
+        assert(ring != NULL);
+        ring->bytes = malloc(UMIO_RING_SIZE);
+        assert(ring->bytes != NULL);
+
+        pthread_mutex_init(&ring->lock, NULL);
+        pthread_cond_init(&ring->wake, NULL);
+        ring->fd = fd;
+
+        int created = pthread_create(&ring->thread, NULL, thread_main, ring);
+        assert(created == 0);
+        (void)created;
+        return ring;
+}
+
+/*      ring_free
+ * Purpose: close a ring, wait for its thread to finish, & free it
+ * Expectations: ring came from ring_new, the guest's side is done
+ * Input: the ring
+ * Output: N/A, void - end result: thread joined & ring freed
+ * Note: the writer drains whatever is left before it sees the close;
+ *       the reader is cancelled, in case it is blocked in read()
+ */
+static void ring_free(Umio_ring *ring)
+{
+        __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+        ring_wake(ring);
+        pthread_cancel(ring->thread);
+        pthread_join(ring->thread, NULL);
+
+        pthread_mutex_destroy(&ring->lock);
+        pthread_cond_destroy(&ring->wake);
+        free(ring->bytes);
+        free(ring);
+}
+
+/*      ring_sleep
+ * Purpose: block until the other side moves one of the ring's indices,
+ *          or closes the ring
+ * Expectations: ring exists, index is its head or tail
+ * Input: the ring, the index waited on, the value last seen there
+ * Output: N/A, void - end result: index has moved, or ring is closed
+ * Note: sleepers is raised before index is checked again, & the other
+ *       side moves the index before checking sleepers (both seq_cst),
+ *       so a wake up can't fall between the check & the wait
+ */
+static void ring_sleep(Umio_ring *ring, size_t *index, size_t seen)
+{
+        pthread_mutex_lock(&ring->lock);
+        __atomic_add_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+
+        while (__atomic_load_n(index, __ATOMIC_SEQ_CST) == seen &&
+               !__atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST)) {
+                pthread_cond_wait(&ring->wake, &ring->lock);
+        }
+
+        __atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&ring->lock);
+}
+
+/*      ring_wake
+ * Purpose: wake the other side of a ring, if it is asleep
+ * Expectations: ring exists, an index (or closed) was just stored
+ * Input: the ring
+ * Output: N/A, void - end result: any sleepers woken
+ */
+static void ring_wake(Umio_ring *ring)
+{
+        if (__atomic_load_n(&ring->sleepers, __ATOMIC_SEQ_CST) > 0) {
+                pthread_mutex_lock(&ring->lock);
+                pthread_cond_broadcast(&ring->wake);
+                pthread_mutex_unlock(&ring->lock);
+        }
+}
+
+/*      ring_fill
+ * Purpose: refill the input buffer from the reader's ring, waiting for
+ *          the reader if nothing has arrived yet
+ * Expectations: io is async, input buffer is empty
+ * Input: Um_io
+ * Output: next byte of input, or UMIO_EOF once the reader has hit the
+ *         end of input & the ring is empty
+ */
+static uint32_t ring_fill(Um_io io)
+{
+        Umio_ring *ring = io->in_ring;
+        size_t head = ring->head;
+        size_t tail;
+
+        /* Note: closed is read first, so the tail read after it is final */
+        for (;;) {
+                int closed = __atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST);
+                tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+                if (tail != head) {
+                        break;
+                } else if (closed) {
+                        io->in_eof = 1;
+                        return UMIO_EOF;
+                }
+                ring_sleep(ring, &ring->tail, tail);
+        }
+
+        /* take as much as is there, up to the wrap & the buffer size */
+        size_t start = head % UMIO_RING_SIZE;
+        size_t n = tail - head;
+        if (n > UMIO_RING_SIZE - start) {
+                n = UMIO_RING_SIZE - start;
+        }
+        if (n > UMIO_BUFFER_SIZE) {
+                n = UMIO_BUFFER_SIZE;
+        }
+        memcpy(io->in_buf, ring->bytes + start, n);
+
+        __atomic_store_n(&ring->head, head + n, __ATOMIC_SEQ_CST);
+        ring_wake(ring);
+
+        io->in_len = n;
+        io->in_pos = 1;
+        return io->in_buf[0];
+}
+
+/*      ring_flush
+ * Purpose: hand the output buffer to the writer's ring, waiting for
+ *          the writer only if the ring is full
+ * Expectations: io is async
+ * Input: Um_io
+ * Output: N/A, void - end result: output buffer empty
+ */
+static void ring_flush(Um_io io)
+{
+        Umio_ring *ring = io->out_ring;
+        size_t tail = ring->tail;
+        size_t copied = 0;
+
+        while (copied < io->out_len) {
+                size_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+                if (tail - head == UMIO_RING_SIZE) {
+                        ring_sleep(ring, &ring->head, head);
+                        continue;
+                }
+
+                size_t start = tail % UMIO_RING_SIZE;
+                size_t n = io->out_len - copied;
+                if (n > UMIO_RING_SIZE - (tail - head)) {
+                        n = UMIO_RING_SIZE - (tail - head);
+                }
+                if (n > UMIO_RING_SIZE - start) {
+                        n = UMIO_RING_SIZE - start;
+                }
+                memcpy(ring->bytes + start, io->out_buf + copied, n);
+                copied += n;
+                tail += n;
+
+                __atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+                ring_wake(ring);
+        }
+
+        io->out_len = 0;
+        if (io->flush_interval_ns != 0) {
+                io->last_flush_ns = now_ns();
+        }
+}
+
+/*      reader_main
+ * Purpose: the reader thread: read() input into the ring as fast as it
+ *          arrives & there is room for it, until the end of input
+ * Expectations: ring came from ring_new
+ * Input: the ring
+ * Output: NULL, once input ends (or the ring is closed)
+ * Note: only cancellable inside read(), so a cancel can never catch it
+ *       holding the lock
+ */
+static void *reader_main(void *arg)
+{
+        Umio_ring *ring = arg;
+        size_t tail = ring->tail;
+
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        while (!__atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST)) {
+                size_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+                if (tail - head == UMIO_RING_SIZE) {
+                        ring_sleep(ring, &ring->head, head);
+                        continue;
+                }
+
+                size_t start = tail % UMIO_RING_SIZE;
+                size_t room = UMIO_RING_SIZE - (tail - head);
+                if (room > UMIO_RING_SIZE - start) {
+                        room = UMIO_RING_SIZE - start;
+                }
+
+                pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+                ssize_t n = read(ring->fd, ring->bytes + start, room);
+                pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                } else if (n <= 0) {
+                        break;
+                }
+                tail += n;
+                __atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+                ring_wake(ring);
+        }
+
+        __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+        ring_wake(ring);
+        return NULL;
+}
+
+/*      writer_main
+ * Purpose: the writer thread: write() whatever the guest has output,
+ *          until the ring is closed & empty
+ * Expectations: ring came from ring_new
+ * Input: the ring
+ * Output: NULL, once all output is written
+ * Note: output the descriptor won't take is dropped, as umio_flush
+ *       drops it
+ */
+static void *writer_main(void *arg)
+{
+        Umio_ring *ring = arg;
+        size_t head = ring->head;
+
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        /* Note: closed is read first, so the tail read after it is final */
+        for (;;) {
+                int closed = __atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST);
+                size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+                if (tail == head) {
+                        if (closed) {
+                                break;
+                        }
+                        ring_sleep(ring, &ring->tail, tail);
+                        continue;
+                }
+
+                size_t start = head % UMIO_RING_SIZE;
+                size_t n = tail - head;
+                if (n > UMIO_RING_SIZE - start) {
+                        n = UMIO_RING_SIZE - start;
+                }
+
+                ssize_t written = write(ring->fd, ring->bytes + start, n);
+                if (written < 0 && errno == EINTR) {
+                        continue;
+                } else if (written > 0) {
+                        n = written;
+                }
+                head += n;
+                __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+                ring_wake(ring);
+        }
+        return NULL;
+}
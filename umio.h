@@ -0,0 +1,133 @@
+/*
+ *              ** umio.h **
+ *    Authors: Adrien Lynch & Silas Reed
+ *                 jlynch07 & sreed05
+ *       Date: Nov 22, 2022
+ * Assignment: HW6
+ *    Summary: The Umio interface: buffered byte I/O for the guest
+ *             program's Input & Output instructions
+ * 
+ */
+
+#ifndef UMIO_H
+#define UMIO_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "assert.h"
+
+
+/* what Input loads once the input is exhausted */
+#define UMIO_EOF 0xFFFFFFFF
+
+/* 
+ * Callback I/O (for libum), in place of the descriptors: a reader
+ * returns how many bytes it put in bytes (at most size), 0 at the end
+ * of input, or UMIO_AGAIN if none are ready yet; a writer takes all
+ * it is given
+ */
+#define UMIO_AGAIN (-1)
+
+typedef long (*Umio_reader)(void *context, uint8_t *bytes, size_t size);
+typedef void (*Umio_writer)(void *context, const uint8_t *bytes,
+                            size_t size);
+
+typedef struct Um_io {
+        int in_fd;
+        int out_fd;
+
+        /* bytes read() but not yet handed to the guest */
+        uint8_t *in_buf;
+        size_t in_pos;
+        size_t in_len;
+        int in_eof;
+
+        /* bytes output by the guest but not yet written */
+        uint8_t *out_buf;
+        size_t out_len;
+
+        /* 
+         * flush policy: always when full, before blocking on input, &
+         * at exit; also at each newline if interactive, & whenever
+         * flush_interval_ns has passed since the last flush (if not 0),
+         * as checked at each Output & Input (& by umio_flush_due)
+         */
+        int interactive;
+        uint64_t flush_interval_ns;
+        uint64_t last_flush_ns;
+
+        /* 
+         * async mode only (else NULL): rings to & from the threads that
+         * do the blocking read()s & write()s (see umio.c)
+         * Note: the buffers above still stage bytes on the guest's side,
+         *       so the inline fast paths are the same in both modes
+         */
+        struct Umio_ring *in_ring;
+        struct Umio_ring *out_ring;
+
+        /* callback mode only (else NULL): used in place of the fds */
+        Umio_reader reader;
+        Umio_writer writer;
+        void *context;
+} *Um_io;
+
+
+Um_io umio_new(int in_fd, int out_fd, int interactive,
+               uint64_t flush_interval_ms, int async);
+
+Um_io umio_new_callbacks(Umio_reader reader, Umio_writer writer,
+                         void *context);
+
+int umio_ready(Um_io io);
+
+void umio_flush(Um_io io);
+
+void umio_flush_due(Um_io io);
+
+void umio_free(Um_io io);
+
+/* out-of-line halves of umio_put & umio_get */
+void umio_put_slow(Um_io io, uint8_t byte);
+
+uint32_t umio_fill(Um_io io);
+
+#define UMIO_BUFFER_SIZE (64 * 1024)
+
+
+/*      umio_put
+ * Purpose: queue one byte of guest output, flushing per the policy
+ * Expectations: io exists
+ * Input: Um_io, byte to write
+ * Output: N/A, void - end result: byte buffered (or written)
+ */
+static inline void umio_put(Um_io io, uint8_t byte)
+{
+        if (io->out_len < UMIO_BUFFER_SIZE - 1 && !io->interactive &&
+            io->flush_interval_ns == 0) {
+                io->out_buf[io->out_len++] = byte;
+        } else {
+                umio_put_slow(io, byte);
+        }
+}
+
+/*      umio_get
+ * Purpose: take one byte of guest input
+ * Expectations: io exists
+ * Input: Um_io
+ * Output: next byte of input, or UMIO_EOF once input is exhausted
+ */
+static inline uint32_t umio_get(Um_io io)
+{
+        if (io->flush_interval_ns != 0) {
+                umio_flush_due(io);
+        }
+        if (io->in_pos < io->in_len) {
+                return io->in_buf[io->in_pos++];
+        }
+        return umio_fill(io);
+}
+
+
+#endif /* UMIO_H */